@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/algorithm.hpp"
+
+// Relocating, copying and destroying large arrays of pointers: element by element
+// through the pointer operations, with the range algorithms, and with them in parallel.
+namespace
+{
+    class particle
+    {
+      public:
+        virtual ~particle() = default;
+
+        [[nodiscard]] virtual auto mass() const noexcept -> float = 0;
+    };
+
+    class point final : public particle
+    {
+      public:
+        explicit point(float mass) noexcept
+          : mass_{mass}
+        {
+        }
+
+        [[nodiscard]] auto mass() const noexcept -> float override
+        {
+            return mass_;
+        }
+
+      private:
+        float mass_;
+        float position_[3] = {};
+    };
+
+    class spinning final : public particle
+    {
+      public:
+        explicit spinning(float mass) noexcept
+          : mass_{mass}
+        {
+        }
+
+        [[nodiscard]] auto mass() const noexcept -> float override
+        {
+            return mass_;
+        }
+
+      private:
+        float mass_;
+        float spin_ = 0;
+    };
+}  // namespace
+
+template <>
+struct sboptr::is_bitwise_copyable<point> : std::true_type
+{
+};
+
+namespace
+{
+    using ptr = sboptr::sbo_ptr<particle, 24>;
+
+    constexpr auto run_length = std::size_t{64};
+
+    // Runs of points and spinning particles; only points are bitwise copyable
+    auto make_particles(std::size_t const n) -> std::vector<ptr>
+    {
+        auto particles = std::vector<ptr>(n);
+        for (auto i = std::size_t{}; i < n; ++i)
+        {
+            if (i / run_length % 2 == 0)
+            {
+                particles[i].emplace<point>(1.0f);
+            }
+            else
+            {
+                particles[i].emplace<spinning>(2.0f);
+            }
+        }
+        return particles;
+    }
+
+    class raw_particles
+    {
+      public:
+        explicit raw_particles(std::size_t const n)
+          : storage_{std::make_unique<std::byte[]>(n * sizeof(ptr))}
+        {
+        }
+
+        [[nodiscard]] auto get() noexcept -> ptr*
+        {
+            return std::launder(reinterpret_cast<ptr*>(storage_.get()));
+        }
+
+      private:
+        std::unique_ptr<std::byte[]> storage_;
+    };
+
+    enum class mode
+    {
+        loop,
+        range,
+        parallel
+    };
+
+    template <mode m>
+    void bm_relocate_n(benchmark::State& state)
+    {
+        auto const n = static_cast<std::size_t>(state.range(0));
+        auto particles = make_particles(n);
+        auto a = raw_particles{n};
+        auto b = raw_particles{n};
+        sboptr::uninitialized_relocate_n(particles.data(), n, a.get());
+        std::uninitialized_default_construct_n(particles.data(), n);
+
+        auto* from = a.get();
+        auto* to = b.get();
+        for (auto _ : state)
+        {
+            if constexpr (m == mode::loop)
+            {
+                for (auto i = std::size_t{}; i < n; ++i)
+                {
+                    new (to + i) ptr{std::move(from[i])};
+                    from[i].~ptr();
+                }
+            }
+            else if constexpr (m == mode::range)
+            {
+                sboptr::uninitialized_relocate_n(from, n, to);
+            }
+            else
+            {
+                sboptr::uninitialized_relocate_n(sboptr::parallel, from, n, to);
+            }
+            benchmark::DoNotOptimize(to);
+            std::swap(from, to);
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+        sboptr::destroy_n(from, n);
+    }
+
+    template <mode m>
+    void bm_copy_n(benchmark::State& state)
+    {
+        auto const n = static_cast<std::size_t>(state.range(0));
+        auto const particles = make_particles(n);
+        auto copies = std::vector<ptr>(n);
+
+        for (auto _ : state)
+        {
+            if constexpr (m == mode::loop)
+            {
+                std::copy_n(particles.data(), n, copies.data());
+            }
+            else if constexpr (m == mode::range)
+            {
+                sboptr::copy_n(particles.data(), n, copies.data());
+            }
+            else
+            {
+                sboptr::copy_n(sboptr::parallel, particles.data(), n, copies.data());
+            }
+            benchmark::DoNotOptimize(copies.data());
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    }
+
+    template <mode m>
+    void bm_destroy_n(benchmark::State& state)
+    {
+        auto const n = static_cast<std::size_t>(state.range(0));
+        auto particles = make_particles(n);
+        auto storage = raw_particles{n};
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::uninitialized_copy_n(particles.data(), n, storage.get());
+            state.ResumeTiming();
+            if constexpr (m == mode::loop)
+            {
+                std::destroy_n(storage.get(), n);
+            }
+            else if constexpr (m == mode::range)
+            {
+                sboptr::destroy_n(storage.get(), n);
+            }
+            else
+            {
+                sboptr::destroy_n(sboptr::parallel, storage.get(), n);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    }
+}  // namespace
+
+BENCHMARK_TEMPLATE(bm_relocate_n, mode::loop)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_relocate_n, mode::range)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_relocate_n, mode::parallel)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_copy_n, mode::loop)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_copy_n, mode::range)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_copy_n, mode::parallel)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_destroy_n, mode::loop)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_destroy_n, mode::range)->Arg(1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_destroy_n, mode::parallel)->Arg(1 << 20)->UseRealTime();
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/sboptr.hpp"
+
+// Latency of reset and move when neither the pointers nor their vtables
+// are in cache: the pointers are visited in random order over a working set
+// larger than the last level cache.
+namespace
+{
+    constexpr auto num_ptrs = std::size_t{1} << 20;
+
+    class interface
+    {
+      public:
+        virtual ~interface() = default;
+
+        [[nodiscard]] virtual auto foo() const noexcept -> int = 0;
+    };
+
+    // Not trivially relocatable, so moving it in place needs the vtable
+    class impl : public interface
+    {
+      public:
+        explicit impl(int const value)
+          : str_(static_cast<std::size_t>(value % 8), 'x')
+        {
+        }
+
+        [[nodiscard]] auto foo() const noexcept -> int override
+        {
+            return static_cast<int>(str_.size());
+        }
+
+      private:
+        std::string str_;
+    };
+
+    constexpr auto sbo_size = sizeof(impl);
+
+    using inline_ptr = sboptr::unique_sbo_ptr<interface, sbo_size>;
+    using heap_ptr = sboptr::unique_sbo_ptr<interface, sizeof(void*)>;
+    using pinned_ptr = sboptr::pinned_sbo_ptr<interface, sizeof(void*)>;
+
+    [[nodiscard]] auto shuffled_indices() -> std::vector<std::size_t>
+    {
+        auto indices = std::vector<std::size_t>(num_ptrs);
+        std::iota(indices.begin(), indices.end(), std::size_t{});
+        std::shuffle(indices.begin(), indices.end(), std::mt19937{42});
+        return indices;
+    }
+
+    template <typename Ptr>
+    void fill(std::vector<Ptr>& ptrs)
+    {
+        for (auto i = std::size_t{}; i < ptrs.size(); ++i)
+        {
+            ptrs[i].template emplace<impl>(static_cast<int>(i));
+        }
+    }
+
+    template <typename Ptr>
+    void bm_reset_cold(benchmark::State& state)
+    {
+        auto const indices = shuffled_indices();
+        auto ptrs = std::vector<Ptr>(num_ptrs);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            fill(ptrs);
+            state.ResumeTiming();
+
+            for (auto const index : indices)
+            {
+                ptrs[index] = nullptr;
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * num_ptrs));
+    }
+
+    template <typename Ptr>
+    void bm_move_cold(benchmark::State& state)
+    {
+        auto const indices = shuffled_indices();
+        auto from = std::vector<Ptr>(num_ptrs);
+        auto to = std::vector<Ptr>(num_ptrs);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            fill(from);
+            state.ResumeTiming();
+
+            for (auto const index : indices)
+            {
+                to[index] = std::move(from[index]);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * num_ptrs));
+    }
+}  // namespace
+
+BENCHMARK_TEMPLATE(bm_reset_cold, inline_ptr)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(bm_reset_cold, heap_ptr)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(bm_reset_cold, pinned_ptr)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(bm_move_cold, inline_ptr)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(bm_move_cold, heap_ptr)->Unit(benchmark::kMillisecond);
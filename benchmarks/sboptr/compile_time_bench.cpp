@@ -0,0 +1,95 @@
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "sboptr/sboptr.hpp"
+
+// Compile-time benchmark: SBOPTR_BENCH_ALIASES pointer types, each used with
+// SBOPTR_BENCH_TYPES implementation classes. Only compiled, never run; the
+// time it takes shows how much the pointer templates cost to instantiate.
+#ifndef SBOPTR_BENCH_ALIASES
+#define SBOPTR_BENCH_ALIASES 24
+#endif
+
+#ifndef SBOPTR_BENCH_TYPES
+#define SBOPTR_BENCH_TYPES 16
+#endif
+
+namespace
+{
+    class interface
+    {
+      public:
+        virtual ~interface() = default;
+
+        [[nodiscard]] virtual auto value() const noexcept -> int = 0;
+    };
+
+    // Even ones fit every buffer, odd ones need the heap
+    template <std::size_t n>
+    class impl final : public interface
+    {
+      public:
+        [[nodiscard]] auto value() const noexcept -> int override
+        {
+            return static_cast<int>(n) + static_cast<int>(data_[0]);
+        }
+
+      private:
+        std::byte data_[n % 2 == 0 ? 8 : 64] = {};
+    };
+
+    constexpr sboptr::sbo_ptr_options kinds[] = {
+        sboptr::no_options,
+        sboptr::allow_heap,
+        sboptr::movable,
+        sboptr::movable | sboptr::allow_heap,
+        sboptr::movable | sboptr::copyable,
+        sboptr::movable | sboptr::copyable | sboptr::allow_heap,
+    };
+
+    constexpr auto kind_count = sizeof(kinds) / sizeof(kinds[0]);
+
+    // Every alias is a separate instantiation, with its own buffer size
+    template <std::size_t i>
+    using ptr = sboptr::basic_sbo_ptr<interface, 24 + 8 * (i / kind_count), kinds[i % kind_count]>;
+
+    template <typename Ptr, typename T>
+    auto use() -> int
+    {
+        auto ptr = Ptr{std::in_place_type<T>};
+        auto sum = ptr->value() + static_cast<int>(ptr.template holds<T>());
+        ptr.template emplace<T>();
+        if constexpr (std::is_move_constructible_v<Ptr>)
+        {
+            auto moved = std::move(ptr);
+            sum += moved->value();
+            ptr = std::move(moved);
+        }
+        if constexpr (std::is_copy_constructible_v<Ptr>)
+        {
+            auto const copy = ptr;
+            sum += copy->value();
+        }
+        return sum;
+    }
+
+    template <std::size_t i, std::size_t... types>
+    auto use_alias(std::index_sequence<types...>) -> int
+    {
+        // Pointers without heap fallback only get the small classes
+        constexpr auto step = (kinds[i % kind_count] & sboptr::allow_heap) != 0 ? 1 : 2;
+        return (use<ptr<i>, impl<types * step>>() + ...);
+    }
+
+    template <std::size_t... aliases>
+    auto use_aliases(std::index_sequence<aliases...>) -> int
+    {
+        return (use_alias<aliases>(std::make_index_sequence<SBOPTR_BENCH_TYPES>{}) + ...);
+    }
+}  // namespace
+
+auto sboptr_compile_time_bench() -> int
+{
+    return use_aliases(std::make_index_sequence<SBOPTR_BENCH_ALIASES>{});
+}
@@ -0,0 +1,61 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/sboptr.hpp"
+
+// One strategy per thread in a shared array, each thread only writing its own:
+// plain pointers share cache lines with their neighbours, cache_aligned ones do not.
+namespace
+{
+    class strategy
+    {
+      public:
+        virtual ~strategy() = default;
+
+        virtual void on_tick() noexcept = 0;
+    };
+
+    class counting_strategy final : public strategy
+    {
+      public:
+        void on_tick() noexcept override
+        {
+            ++ticks_;
+        }
+
+      private:
+        std::uint64_t ticks_ = 0;
+    };
+
+    constexpr auto sbo_size = std::size_t{48};
+    constexpr auto max_threads = 64;
+    constexpr auto ticks_per_iteration = 1000;
+
+    template <typename Ptr>
+    void bm_tick_per_thread(benchmark::State& state)
+    {
+        static auto strategies = std::array<Ptr, max_threads>{};
+        auto& own = strategies[static_cast<std::size_t>(state.thread_index())];
+        own.template emplace<counting_strategy>();
+
+        for (auto _ : state)
+        {
+            // Every tick is written back to memory
+            for (auto i = 0; i < ticks_per_iteration; ++i)
+            {
+                own->on_tick();
+                benchmark::ClobberMemory();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * ticks_per_iteration);
+        own.reset();
+    }
+
+    using plain_ptr = sboptr::unique_sbo_ptr<strategy, sbo_size>;
+    using cache_aligned_ptr = sboptr::basic_sbo_ptr<strategy, sbo_size, sboptr::movable | sboptr::allow_heap | sboptr::cache_aligned>;
+}  // namespace
+
+BENCHMARK_TEMPLATE(bm_tick_per_thread, plain_ptr)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(bm_tick_per_thread, cache_aligned_ptr)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,506 @@
+#include <any>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/sboptr.hpp"
+#include "sboptr/shared_sbo_ptr.hpp"
+
+// Basic operations of every pointer kind, with objects around the small
+// buffer size, compared to the standard library's type erasure.
+namespace
+{
+    constexpr auto sbo_size = std::size_t{32};
+    constexpr auto batch_size = std::size_t{1024};
+
+    class interface
+    {
+      public:
+        virtual ~interface() = default;
+
+        [[nodiscard]] virtual auto foo() const noexcept -> int = 0;
+    };
+
+    template <std::size_t size>
+    class impl final : public interface
+    {
+      public:
+        static constexpr auto object_size = size;
+
+        [[nodiscard]] auto foo() const noexcept -> int override
+        {
+            return static_cast<int>(payload_[0]);
+        }
+
+        // For std::function
+        auto operator()() const noexcept -> int
+        {
+            return foo();
+        }
+
+      private:
+        std::array<unsigned char, size - sizeof(void*)> payload_ = {};
+    };
+
+    using impl_small = impl<sbo_size / 2>;
+    using impl_exact = impl<sbo_size>;
+    using impl_big = impl<sbo_size + sbo_size / 2>;
+}  // namespace
+
+template <std::size_t size>
+struct sboptr::is_trivially_relocatable<impl<size>> : std::true_type
+{
+};
+
+namespace
+{
+    // Uniform interface over the compared types
+    template <typename Holder>
+    struct holder_traits;
+
+    template <std::size_t size, sboptr::sbo_ptr_options opts, typename Allocator, std::size_t align, typename Members>
+    struct holder_traits<sboptr::basic_sbo_ptr<interface, size, opts, Allocator, align, Members>>
+    {
+        using holder = sboptr::basic_sbo_ptr<interface, size, opts, Allocator, align, Members>;
+
+        template <typename D>
+        static constexpr bool can_hold = (opts & sboptr::allow_heap) || holder::template stores_inline<D>;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return holder{std::in_place_type<D>};
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h.template emplace<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h.reset();
+        }
+
+        static auto call(holder const& h) noexcept -> int
+        {
+            return h->foo();
+        }
+    };
+
+    template <std::size_t size, sboptr::sbo_ptr_options opts, typename Allocator>
+    struct holder_traits<sboptr::shared_sbo_ptr<interface, size, opts, Allocator>>
+    {
+        using holder = sboptr::shared_sbo_ptr<interface, size, opts, Allocator>;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return holder{std::in_place_type<D>};
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h.template emplace<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h.reset();
+        }
+
+        static auto call(holder const& h) noexcept -> int
+        {
+            return h->foo();
+        }
+    };
+
+    template <>
+    struct holder_traits<std::shared_ptr<interface>>
+    {
+        using holder = std::shared_ptr<interface>;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return std::make_shared<D>();
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h = std::make_shared<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h.reset();
+        }
+
+        static auto call(holder const& h) noexcept -> int
+        {
+            return h->foo();
+        }
+    };
+
+    template <>
+    struct holder_traits<std::unique_ptr<interface>>
+    {
+        using holder = std::unique_ptr<interface>;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return std::make_unique<D>();
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h = std::make_unique<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h.reset();
+        }
+
+        static auto call(holder const& h) noexcept -> int
+        {
+            return h->foo();
+        }
+    };
+
+    template <>
+    struct holder_traits<std::function<int()>>
+    {
+        using holder = std::function<int()>;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return holder{D{}};
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h = D{};
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h = nullptr;
+        }
+
+        static auto call(holder const& h) -> int
+        {
+            return h();
+        }
+    };
+
+    template <>
+    struct holder_traits<std::any>
+    {
+        using holder = std::any;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return holder{std::in_place_type<D>};
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h.emplace<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h.reset();
+        }
+
+        // std::any has no common interface, so the benchmark has to know the type
+        template <typename D>
+        static auto call(holder const& h) noexcept -> int
+        {
+            return std::any_cast<D const&>(h).foo();
+        }
+    };
+
+    using variant = std::variant<std::monostate, impl_small, impl_exact, impl_big>;
+
+    template <>
+    struct holder_traits<variant>
+    {
+        using holder = variant;
+
+        template <typename D>
+        static constexpr bool can_hold = true;
+
+        template <typename D>
+        static auto make() -> holder
+        {
+            return holder{std::in_place_type<D>};
+        }
+
+        template <typename D>
+        static void emplace(holder& h)
+        {
+            h.emplace<D>();
+        }
+
+        static void reset(holder& h) noexcept
+        {
+            h = std::monostate{};
+        }
+
+        static auto call(holder const& h) noexcept -> int
+        {
+            return std::visit(
+                [](auto const& object) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(object)>, std::monostate>)
+                    {
+                        return 0;
+                    }
+                    else
+                    {
+                        return object.foo();
+                    }
+                },
+                h);
+        }
+    };
+
+    template <typename Holder, typename D>
+    auto call(Holder const& h) -> int
+    {
+        if constexpr (std::is_same_v<Holder, std::any>)
+        {
+            return holder_traits<Holder>::template call<D>(h);
+        }
+        else
+        {
+            return holder_traits<Holder>::call(h);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_construct(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto h = Holder{holder_traits<Holder>::template make<D>()};
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    // Pinned pointers can not be returned from make
+    template <typename Holder, typename D>
+    void bm_construct_in_place(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto h = Holder{std::in_place_type<D>};
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_emplace(benchmark::State& state)
+    {
+        auto h = Holder{};
+        for (auto _ : state)
+        {
+            holder_traits<Holder>::template emplace<D>(h);
+            benchmark::DoNotOptimize(h);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_reset(benchmark::State& state)
+    {
+        auto holders = std::vector<Holder>(batch_size);
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            for (auto& h : holders)
+            {
+                holder_traits<Holder>::template emplace<D>(h);
+            }
+            state.ResumeTiming();
+
+            for (auto& h : holders)
+            {
+                holder_traits<Holder>::reset(h);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * batch_size));
+    }
+
+    template <typename Holder, typename D>
+    void bm_move(benchmark::State& state)
+    {
+        auto a = holder_traits<Holder>::template make<D>();
+        for (auto _ : state)
+        {
+            auto b = std::move(a);
+            a = std::move(b);
+            benchmark::DoNotOptimize(a);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_copy(benchmark::State& state)
+    {
+        auto const a = holder_traits<Holder>::template make<D>();
+        for (auto _ : state)
+        {
+            auto b = a;
+            benchmark::DoNotOptimize(b);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_swap(benchmark::State& state)
+    {
+        auto a = holder_traits<Holder>::template make<D>();
+        auto b = holder_traits<Holder>::template make<D>();
+        for (auto _ : state)
+        {
+            using std::swap;
+            swap(a, b);
+            benchmark::DoNotOptimize(a);
+            benchmark::DoNotOptimize(b);
+        }
+    }
+
+    template <typename Holder, typename D>
+    void bm_iterate(benchmark::State& state)
+    {
+        auto holders = std::vector<Holder>{};
+        holders.reserve(batch_size);
+        for (auto i = std::size_t{}; i < batch_size; ++i)
+        {
+            holders.push_back(holder_traits<Holder>::template make<D>());
+        }
+
+        for (auto _ : state)
+        {
+            auto sum = 0;
+            for (auto const& h : holders)
+            {
+                sum += call<Holder, D>(h);
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * batch_size));
+    }
+
+    template <typename Holder, typename D>
+    void register_holder_with(std::string const& holder_name)
+    {
+        if constexpr (holder_traits<Holder>::template can_hold<D>)
+        {
+            auto const name = [&](char const* const operation) {
+                return std::string{operation} + "/" + holder_name + "/derived:" + std::to_string(D::object_size);
+            };
+
+            if constexpr (std::is_move_constructible_v<Holder>)
+            {
+                benchmark::RegisterBenchmark(name("construct").c_str(), bm_construct<Holder, D>);
+                benchmark::RegisterBenchmark(name("move").c_str(), bm_move<Holder, D>);
+                benchmark::RegisterBenchmark(name("swap").c_str(), bm_swap<Holder, D>);
+                benchmark::RegisterBenchmark(name("reset").c_str(), bm_reset<Holder, D>);
+                benchmark::RegisterBenchmark(name("iterate").c_str(), bm_iterate<Holder, D>);
+            }
+            else
+            {
+                benchmark::RegisterBenchmark(name("construct").c_str(), bm_construct_in_place<Holder, D>);
+            }
+            benchmark::RegisterBenchmark(name("emplace").c_str(), bm_emplace<Holder, D>);
+            if constexpr (std::is_copy_constructible_v<Holder>)
+            {
+                benchmark::RegisterBenchmark(name("copy").c_str(), bm_copy<Holder, D>);
+            }
+        }
+    }
+
+    template <typename Holder>
+    void register_holder(std::string const& holder_name)
+    {
+        register_holder_with<Holder, impl_small>(holder_name);
+        register_holder_with<Holder, impl_exact>(holder_name);
+        register_holder_with<Holder, impl_big>(holder_name);
+    }
+
+    template <sboptr::sbo_ptr_options opts>
+    void register_sbo_ptr(std::string const& name)
+    {
+        using namespace sboptr;
+
+        register_holder<basic_sbo_ptr<interface, sbo_size, opts>>(name);
+        if constexpr ((opts & movable) != 0)
+        {
+            register_holder<basic_sbo_ptr<interface, sbo_size, opts | compact>>(name + "|compact");
+            register_holder<basic_sbo_ptr<interface, sbo_size, opts | trivially_relocatable>>(name + "|trivially_relocatable");
+            register_holder<basic_sbo_ptr<interface, sbo_size, opts | compact | trivially_relocatable>>(name + "|compact|trivially_relocatable");
+        }
+        if constexpr ((opts & allow_heap) != 0)
+        {
+            register_holder<basic_sbo_ptr<interface, sbo_size, opts | pooled>>(name + "|pooled");
+        }
+        if constexpr ((opts & copyable) != 0 && (opts & allow_heap) != 0)
+        {
+            register_holder<basic_sbo_ptr<interface, sbo_size, opts | cow>>(name + "|cow");
+        }
+    }
+
+    auto const registered = [] {
+        using namespace sboptr;
+
+        register_sbo_ptr<no_options>("pinned_no_alloc_sbo_ptr");
+        register_sbo_ptr<allow_heap>("pinned_sbo_ptr");
+        register_sbo_ptr<movable>("unique_no_alloc_sbo_ptr");
+        register_sbo_ptr<movable | allow_heap>("unique_sbo_ptr");
+        register_sbo_ptr<movable | copyable>("no_alloc_sbo_ptr");
+        register_sbo_ptr<movable | copyable | allow_heap>("sbo_ptr");
+
+        register_holder<shared_sbo_ptr<interface, sbo_size>>("shared_sbo_ptr");
+        register_holder<shared_sbo_ptr<interface, sbo_size, pooled>>("shared_sbo_ptr|pooled");
+        register_holder<shared_sbo_ptr<interface, sbo_size, non_atomic>>("shared_sbo_ptr|non_atomic");
+
+        register_holder<std::unique_ptr<interface>>("std::unique_ptr");
+        register_holder<std::shared_ptr<interface>>("std::shared_ptr");
+        register_holder<std::function<int()>>("std::function");
+        register_holder<std::any>("std::any");
+        register_holder<variant>("std::variant");
+        return true;
+    }();
+}  // namespace
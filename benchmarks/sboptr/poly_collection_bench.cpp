@@ -0,0 +1,134 @@
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/poly_collection.hpp"
+#include "sboptr/sbo_vector.hpp"
+
+// Update loop over randomly interleaved entity types: type-segregated
+// segments against a single sbo_vector.
+namespace
+{
+    class entity
+    {
+      public:
+        virtual ~entity() = default;
+
+        virtual void update() noexcept = 0;
+    };
+
+    class walker final : public entity
+    {
+      public:
+        void update() noexcept override
+        {
+            position_ += 1.0f;
+        }
+
+      private:
+        float position_ = 0.0f;
+    };
+
+    class spinner final : public entity
+    {
+      public:
+        void update() noexcept override
+        {
+            angle_ *= 1.001f;
+        }
+
+      private:
+        float angle_ = 1.0f;
+    };
+
+    class blinker final : public entity
+    {
+      public:
+        void update() noexcept override
+        {
+            on_ = !on_;
+        }
+
+      private:
+        bool on_ = false;
+    };
+
+    template <typename Container>
+    void fill(Container& entities, std::int64_t const count)
+    {
+        auto random = std::mt19937{42};
+        auto dist = std::uniform_int_distribution{0, 2};
+        for (auto i = std::int64_t{}; i < count; ++i)
+        {
+            switch (dist(random))
+            {
+                case 0:
+                    entities.template emplace_back<walker>();
+                    break;
+                case 1:
+                    entities.template emplace_back<spinner>();
+                    break;
+                default:
+                    entities.template emplace_back<blinker>();
+                    break;
+            }
+        }
+    }
+
+    // Adapts poly_collection to fill
+    class segmented
+    {
+      public:
+        template <typename U>
+        void emplace_back()
+        {
+            entities.emplace<U>();
+        }
+
+        sboptr::poly_collection<entity> entities;
+    };
+
+    void bm_update_sbo_vector(benchmark::State& state)
+    {
+        auto entities = sboptr::sbo_vector<entity, sizeof(void*) * 2>{};
+        fill(entities, state.range(0));
+
+        for (auto _ : state)
+        {
+            entities.for_each([](entity& e) { e.update(); });
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void bm_update_poly_collection(benchmark::State& state)
+    {
+        auto entities = segmented{};
+        fill(entities, state.range(0));
+
+        for (auto _ : state)
+        {
+            entities.entities.for_each([](entity& e) { e.update(); });
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void bm_update_poly_collection_static(benchmark::State& state)
+    {
+        auto entities = segmented{};
+        fill(entities, state.range(0));
+
+        for (auto _ : state)
+        {
+            entities.entities.for_each<walker, spinner, blinker>([](auto& e) { e.update(); });
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}  // namespace
+
+BENCHMARK(bm_update_sbo_vector)->Arg(100'000);
+BENCHMARK(bm_update_poly_collection)->Arg(100'000);
+BENCHMARK(bm_update_poly_collection_static)->Arg(100'000);
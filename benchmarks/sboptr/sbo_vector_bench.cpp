@@ -0,0 +1,98 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "sboptr/sbo_vector.hpp"
+
+// Iteration over many small polymorphic objects: sbo_vector slots
+// against a vector of sbo pointers.
+namespace
+{
+    class entity
+    {
+      public:
+        virtual ~entity() = default;
+
+        virtual void tick() noexcept = 0;
+    };
+
+    class particle : public entity
+    {
+      public:
+        void tick() noexcept override
+        {
+            position_ += velocity_;
+        }
+
+      private:
+        float position_ = 0.0f;
+        float velocity_ = 1.0f;
+    };
+
+    class spinner : public entity
+    {
+      public:
+        void tick() noexcept override
+        {
+            angle_ += 0.5f;
+        }
+
+      private:
+        float angle_ = 0.0f;
+    };
+
+    constexpr auto slot_size = sizeof(void*) * 2;
+
+    void bm_tick_vector_of_ptrs(benchmark::State& state)
+    {
+        auto entities = std::vector<sboptr::unique_sbo_ptr<entity, slot_size>>{};
+        for (auto i = std::int64_t{}; i < state.range(0); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                entities.emplace_back(particle{});
+            }
+            else
+            {
+                entities.emplace_back(spinner{});
+            }
+        }
+
+        for (auto _ : state)
+        {
+            for (auto& e : entities)
+            {
+                e->tick();
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void bm_tick_sbo_vector(benchmark::State& state)
+    {
+        auto entities = sboptr::sbo_vector<entity, slot_size>{};
+        for (auto i = std::int64_t{}; i < state.range(0); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                entities.emplace_back<particle>();
+            }
+            else
+            {
+                entities.emplace_back<spinner>();
+            }
+        }
+
+        for (auto _ : state)
+        {
+            entities.for_each([](entity& e) { e.tick(); });
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}  // namespace
+
+BENCHMARK(bm_tick_vector_of_ptrs)->Range(1 << 10, 1 << 20);
+BENCHMARK(bm_tick_sbo_vector)->Range(1 << 10, 1 << 20);
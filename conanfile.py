@@ -11,6 +11,7 @@ class SboPtr(ConanFile):
     settings = "os", "compiler", "build_type", "arch"
     generators = "cmake_paths"
     exports_sources = (
+        "benchmarks/*",
         "examples/*",
         "include/*",
         "tests/*",
@@ -25,7 +26,7 @@ class SboPtr(ConanFile):
 
         cmake.definitions["CMAKE_TOOLCHAIN_FILE"] = "conan_paths.cmake"
         cmake.configure()
-        cmake.build(target="sboptr_tests")
+        cmake.build()
         
         if tools.get_env("CONAN_RUN_TESTS", True):
             cmake.test()
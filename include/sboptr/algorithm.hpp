@@ -0,0 +1,350 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sboptr/sboptr.hpp"
+
+namespace sboptr
+{
+    // Splits a range algorithm across threads, in chunks of at least min_chunk elements
+    struct parallel_policy
+    {
+        // 0 uses std::thread::hardware_concurrency()
+        unsigned threads = 0;
+        std::size_t min_chunk = std::size_t{1} << 16u;
+    };
+
+    inline constexpr auto parallel = parallel_policy{};
+
+    namespace detail
+    {
+        template <typename Ptr>
+        struct sbo_ptr_params;
+
+        template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+        struct sbo_ptr_params<basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>>
+        {
+            static constexpr auto size = sbo_size;
+            static constexpr auto options = opts;
+            using alloc_traits = sbo_ptr_alloc_traits<typename basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>::allocator_type>;
+        };
+
+        // Decision taken once per run of objects of the same type
+        template <typename Vtable>
+        class vtable_run
+        {
+          public:
+            using decide_type = bool (*)(Vtable const*) noexcept;
+
+            explicit vtable_run(decide_type const decide) noexcept
+              : decide_{decide}
+            {
+            }
+
+            [[nodiscard]] auto operator()(Vtable const* const vtable) noexcept -> bool
+            {
+                if (vtable != last_)
+                {
+                    last_ = vtable;
+                    value_ = decide_(vtable);
+                }
+                return value_;
+            }
+
+          private:
+            decide_type decide_;
+            Vtable const* last_ = nullptr;
+            bool value_ = false;
+        };
+
+        struct sbo_ptr_algorithms
+        {
+            template <typename Ptr>
+            using vtable_type = typename Ptr::Base::vtable_type;
+
+            template <typename Ptr>
+            [[nodiscard]] static auto storage(Ptr& ptr) noexcept -> typename Ptr::Base&
+            {
+                return ptr;
+            }
+
+            template <typename Ptr>
+            [[nodiscard]] static auto storage(Ptr const& ptr) noexcept -> typename Ptr::Base const&
+            {
+                return ptr;
+            }
+
+            template <typename Ptr>
+            static void relocate_n(Ptr* const first, std::size_t const n, Ptr* const d_first) noexcept
+            {
+                using params = sbo_ptr_params<Ptr>;
+                static_assert((params::options & movable) != 0, "Only movable pointers can be relocated.");
+
+                if constexpr (is_trivially_relocatable_v<Ptr>)
+                {
+                    if (n != 0)
+                    {
+                        std::memcpy(static_cast<void*>(d_first), static_cast<void const*>(first), n * sizeof(Ptr));
+                    }
+                }
+                else
+                {
+                    auto relocatable = vtable_run<vtable_type<Ptr>>{[](auto const* const vtable) noexcept {
+                        return (params::options & trivially_relocatable) != 0 || vtable->trivially_relocatable;
+                    }};
+                    for (auto i = std::size_t{}; i < n; ++i)
+                    {
+                        auto& from = storage(first[i]);
+                        auto& to = storage(*new (d_first + i) Ptr{first[i].get_allocator()});
+                        if (!from.empty())
+                        {
+                            auto* const vtable = from.vtable();
+                            if (from.on_heap())
+                            {
+                                to.set(from.ptr(), vtable, true);
+                                to.set_budget(from.budget());
+                            }
+                            else if (relocatable(vtable))
+                            {
+                                to.set(relocate_buffer<params::size>(from.buffer(), to.buffer(), from.ptr()), vtable);
+                            }
+                            else
+                            {
+                                to.set(vtable->move(from.buffer(), to.buffer()), vtable);
+                            }
+                            if constexpr (is_instrumented<params::options> && (params::options & allow_heap) != 0)
+                            {
+                                vtable->heap_stats->count_move(false);
+                            }
+                            from.clear();
+                        }
+                        first[i].~Ptr();
+                    }
+                }
+            }
+
+            template <typename Ptr>
+            static void copy_n(Ptr const* const first, std::size_t const n, Ptr* const d_first)
+            {
+                using params = sbo_ptr_params<Ptr>;
+                using alloc_traits = typename params::alloc_traits;
+                static_assert((params::options & copyable) != 0, "Only copyable pointers can be copied.");
+
+                // Otherwise the copy assignment of the pointer decides on the allocator, or shares the object
+                constexpr auto copies_in_place = (params::options & cow) == 0
+                                                 && (alloc_traits::is_always_equal || !alloc_traits::propagate_on_copy_assignment);
+
+                auto bitwise = vtable_run<vtable_type<Ptr>>{[](auto const* const vtable) noexcept {
+                    return vtable->bitwise_copyable;
+                }};
+                for (auto i = std::size_t{}; i < n; ++i)
+                {
+                    auto const& from = storage(first[i]);
+                    if (!copies_in_place || from.empty() || from.on_heap())
+                    {
+                        d_first[i] = first[i];
+                        continue;
+                    }
+
+                    d_first[i].reset();
+                    auto& to = storage(d_first[i]);
+                    auto* const vtable = from.vtable();
+                    if (bitwise(vtable))
+                    {
+                        to.set(relocate_buffer<params::size>(const_cast<void*>(from.buffer()), to.buffer(), from.ptr()), vtable);
+                    }
+                    else
+                    {
+                        auto alloc = d_first[i].get_allocator();
+                        to.set(vtable->copy(from.buffer(), to.buffer(), alloc), vtable);
+                    }
+                    if constexpr (is_instrumented<params::options> && (params::options & allow_heap) != 0)
+                    {
+                        vtable->heap_stats->count_copy(false);
+                    }
+                }
+            }
+
+            template <typename Ptr>
+            static void destroy_n(Ptr* const first, std::size_t const n) noexcept
+            {
+                using params = sbo_ptr_params<Ptr>;
+
+                if constexpr ((params::options & movable) != 0)
+                {
+                    auto bitwise = vtable_run<vtable_type<Ptr>>{[](auto const* const vtable) noexcept {
+                        return vtable->bitwise_copyable;
+                    }};
+                    for (auto i = std::size_t{}; i < n; ++i)
+                    {
+                        auto& ptr = storage(first[i]);
+                        if (!ptr.empty() && !ptr.on_heap() && bitwise(ptr.vtable()))
+                        {
+                            // Ends the lifetime of the object without calling its destructor
+                            ptr.clear();
+                        }
+                        first[i].~Ptr();
+                    }
+                }
+                else
+                {
+                    std::destroy_n(first, n);
+                }
+            }
+        };
+
+        // Calls fn(begin, count) for consecutive chunks of [0, n), on separate threads.
+        // Chunks whose thread can not be started run on the calling thread, and
+        // if the bookkeeping can not be allocated, the whole range does. So only
+        // exceptions thrown by fn propagate, and callers with a non-throwing fn
+        // can be noexcept. Workers charge the heap_budget of the calling thread.
+        template <typename Fn>
+        void parallel_for(parallel_policy const& policy, std::size_t const n, Fn const& fn)
+        {
+            auto const threads = policy.threads != 0 ? policy.threads : std::max(1u, std::thread::hardware_concurrency());
+            auto const chunks = std::min<std::size_t>(threads, n / std::max<std::size_t>(policy.min_chunk, 1));
+            if (chunks <= 1)
+            {
+                fn(std::size_t{}, n);
+                return;
+            }
+
+            auto errors = std::vector<std::exception_ptr>{};
+            auto workers = std::vector<std::thread>{};
+            try
+            {
+                errors.resize(chunks);
+                workers.reserve(chunks - 1);
+            }
+            catch (std::bad_alloc const&)
+            {
+                fn(std::size_t{}, n);
+                return;
+            }
+
+            auto& budget = heap_budget::current();
+            auto run = [&](std::size_t const chunk) {
+                auto const scope = heap_budget_scope{budget};
+                try
+                {
+                    auto const begin = n * chunk / chunks;
+                    fn(begin, n * (chunk + 1) / chunks - begin);
+                }
+                catch (...)
+                {
+                    errors[chunk] = std::current_exception();
+                }
+            };
+
+            for (auto chunk = std::size_t{1}; chunk < chunks; ++chunk)
+            {
+                try
+                {
+                    workers.emplace_back(run, chunk);
+                }
+                catch (...)
+                {
+                    run(chunk);
+                }
+            }
+            run(0);
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+            for (auto const& error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+    }  // namespace detail
+
+    // Range algorithms for arrays of pointers. They work on the storage directly:
+    // runs of objects of the same type take the per-type decision once,
+    // trivially relocatable objects are moved and bitwise copyable ones copied
+    // with memcpy, and the destructors of bitwise copyable objects are skipped.
+    // The ranges must not overlap.
+
+    // Move-constructs the pointers of [d_first, d_first + n) from [first, first + n),
+    // and destroys the latter
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto uninitialized_relocate_n(
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const first,
+        std::size_t const n,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const d_first) noexcept -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::sbo_ptr_algorithms::relocate_n(first, n, d_first);
+        return d_first + n;
+    }
+
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto uninitialized_relocate_n(
+        parallel_policy const& policy,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const first,
+        std::size_t const n,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const d_first) noexcept -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::parallel_for(policy, n, [=](std::size_t const begin, std::size_t const count) {
+            detail::sbo_ptr_algorithms::relocate_n(first + begin, count, d_first + begin);
+        });
+        return d_first + n;
+    }
+
+    // Copy-assigns [first, first + n) to [d_first, d_first + n).
+    // If a copy throws, its destination is left either empty (copies into the
+    // small buffer reset it first) or with its old value (other copies go
+    // through copy assignment).
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto copy_n(
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members> const* const first,
+        std::size_t const n,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const d_first) -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::sbo_ptr_algorithms::copy_n(first, n, d_first);
+        return d_first + n;
+    }
+
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto copy_n(
+        parallel_policy const& policy,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members> const* const first,
+        std::size_t const n,
+        basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const d_first) -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::parallel_for(policy, n, [=](std::size_t const begin, std::size_t const count) {
+            detail::sbo_ptr_algorithms::copy_n(first + begin, count, d_first + begin);
+        });
+        return d_first + n;
+    }
+
+    // Destroys the pointers of [first, first + n)
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto destroy_n(basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const first, std::size_t const n) noexcept
+        -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::sbo_ptr_algorithms::destroy_n(first, n);
+        return first + n;
+    }
+
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    auto destroy_n(parallel_policy const& policy, basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>* const first, std::size_t const n) noexcept
+        -> basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>*
+    {
+        detail::parallel_for(policy, n, [=](std::size_t const begin, std::size_t const count) {
+            detail::sbo_ptr_algorithms::destroy_n(first + begin, count);
+        });
+        return first + n;
+    }
+}  // namespace sboptr
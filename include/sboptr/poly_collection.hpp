@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sboptr/sboptr.hpp"
+
+namespace sboptr
+{
+    namespace detail
+    {
+        // Operations on a contiguous segment of objects of a single type.
+        // Like the pointer vtables, there is one static instance per type,
+        // so its address identifies the type of the segment.
+        template <typename Base, typename Allocator>
+        struct poly_segment_vtable
+        {
+            std::size_t stride;
+            void* (*allocate)(Allocator&, std::size_t);
+            void (*deallocate)(Allocator&, void*, std::size_t) noexcept;
+            void (*relocate)(void*, void*, std::size_t) noexcept;
+            void (*destroy)(void*, std::size_t) noexcept;
+
+            template <typename Derived>
+            static auto get() noexcept -> poly_segment_vtable const*
+            {
+                using traits = typename sbo_ptr_alloc_traits<Allocator>::template rebind_traits<Derived>;
+                using derived_alloc = typename sbo_ptr_alloc_traits<Allocator>::template rebind_alloc<Derived>;
+
+                static constexpr auto vtable = poly_segment_vtable{
+                    sizeof(Derived),
+                    [](Allocator& alloc, std::size_t const n) -> void* {
+                        auto a = derived_alloc{alloc};
+                        return traits::allocate(a, n);
+                    },
+                    [](Allocator& alloc, void* const data, std::size_t const n) noexcept {
+                        auto a = derived_alloc{alloc};
+                        traits::deallocate(a, static_cast<Derived*>(data), n);
+                    },
+                    [](void* const from, void* const to, std::size_t const n) noexcept {
+                        auto* const first = std::launder(static_cast<Derived*>(from));
+                        for (auto i = std::size_t{}; i < n; ++i)
+                        {
+                            new (static_cast<Derived*>(to) + i) Derived(std::move(first[i]));
+                            first[i].~Derived();
+                        }
+                    },
+                    [](void* const data, std::size_t const n) noexcept {
+                        auto* const first = std::launder(static_cast<Derived*>(data));
+                        for (auto i = std::size_t{}; i < n; ++i)
+                        {
+                            first[i].~Derived();
+                        }
+                    },
+                };
+                return &vtable;
+            }
+        };
+
+        template <typename Base, typename Derived, typename... Args>
+        struct can_emplace_segment
+          : std::conjunction<
+                std::is_convertible<Derived*, Base*>,
+                std::is_constructible<Derived, Args&&...>,
+                std::is_nothrow_move_constructible<Derived>>
+        {
+        };
+    }  // namespace detail
+
+    // Polymorphic collection keeping one contiguous segment per concrete type.
+    // Visiting the objects segment by segment keeps the indirect calls
+    // predictable, and for_each<Ts...> visits the listed types statically.
+    // Objects do not keep their address: inserting may move the objects
+    // of the same type.
+    template <typename Base, typename Allocator = default_allocator>
+    class poly_collection : private detail::sbo_ptr_allocator_storage<Allocator>
+    {
+      public:
+        using value_type = Base;
+        using size_type = std::size_t;
+        using allocator_type = Allocator;
+
+      private:
+        using allocator_storage = detail::sbo_ptr_allocator_storage<Allocator>;
+        using alloc_traits = detail::sbo_ptr_alloc_traits<Allocator>;
+        using segment_vtable = detail::poly_segment_vtable<Base, Allocator>;
+
+        struct segment
+        {
+            segment_vtable const* vtable;
+            void* data;
+            std::size_t size;
+            std::size_t capacity;
+            // Offset of Base within the objects, known after the first insertion
+            std::ptrdiff_t base_offset;
+        };
+
+        using segment_alloc = typename alloc_traits::template rebind_alloc<segment>;
+
+      public:
+        poly_collection() noexcept = default;
+
+        explicit poly_collection(allocator_type const& alloc) noexcept
+          : allocator_storage{alloc},
+            segments_{segment_alloc{alloc}}
+        {
+        }
+
+        poly_collection(poly_collection const&) = delete;
+
+        poly_collection(poly_collection&& other) noexcept
+          : allocator_storage{other.allocator()},
+            segments_{std::move(other.segments_)}
+        {
+            other.segments_.clear();
+        }
+
+        auto operator=(poly_collection const&) = delete;
+
+        auto operator=(poly_collection&& other) noexcept(alloc_traits::propagate_on_move_assignment || alloc_traits::is_always_equal) -> poly_collection&
+        {
+            if (this != &other)
+            {
+                deallocate();
+                if constexpr (alloc_traits::propagate_on_move_assignment)
+                {
+                    this->allocator() = other.allocator();
+                }
+                if (alloc_traits::equal(this->allocator(), other.allocator()))
+                {
+                    segments_ = std::move(other.segments_);
+                }
+                else
+                {
+                    move_segments_from(other);
+                }
+                other.segments_.clear();
+            }
+            return *this;
+        }
+
+        ~poly_collection() noexcept
+        {
+            deallocate();
+        }
+
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<detail::can_emplace_segment<Base, U, Args&&...>::value>>
+        auto emplace(Args&&... args) -> U&
+        {
+            auto& seg = segment_for<U>();
+            if (seg.size == seg.capacity)
+            {
+                // The new object is constructed before the old ones are moved,
+                // so a throwing constructor leaves the collection unchanged
+                auto const new_capacity = seg.capacity == 0 ? 4 : seg.capacity * 2;
+                auto* const new_data = seg.vtable->allocate(this->allocator(), new_capacity);
+                try
+                {
+                    construct<U>(seg, new_data, std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    seg.vtable->deallocate(this->allocator(), new_data, new_capacity);
+                    throw;
+                }
+                seg.vtable->relocate(seg.data, new_data, seg.size);
+                if (seg.capacity != 0)
+                {
+                    seg.vtable->deallocate(this->allocator(), seg.data, seg.capacity);
+                }
+                seg.data = new_data;
+                seg.capacity = new_capacity;
+            }
+            else
+            {
+                construct<U>(seg, seg.data, std::forward<Args>(args)...);
+            }
+            return std::launder(static_cast<U*>(seg.data))[seg.size++];
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<detail::can_emplace_segment<Base, std::decay_t<U>, U&&>::value>>
+        auto insert(U&& value) -> std::decay_t<U>&
+        {
+            return emplace<std::decay_t<U>>(std::forward<U>(value));
+        }
+
+        // Visits all objects, one segment at a time
+        template <typename F>
+        void for_each(F&& f)
+        {
+            for (auto const& seg : segments_)
+            {
+                visit_segment<Base>(seg, f);
+            }
+        }
+
+        template <typename F>
+        void for_each(F&& f) const
+        {
+            for (auto const& seg : segments_)
+            {
+                visit_segment<Base const>(seg, f);
+            }
+        }
+
+        // Visits all objects; those of the listed types are passed as their
+        // concrete type, so calls on them can be resolved at compile time.
+        template <typename... Ts, typename F, typename = std::enable_if_t<(sizeof...(Ts) > 0)>>
+        void for_each(F&& f)
+        {
+            for (auto const& seg : segments_)
+            {
+                if (!(visit_if<Ts>(seg, f) || ...))
+                {
+                    visit_segment<Base>(seg, f);
+                }
+            }
+        }
+
+        template <typename... Ts, typename F, typename = std::enable_if_t<(sizeof...(Ts) > 0)>>
+        void for_each(F&& f) const
+        {
+            for (auto const& seg : segments_)
+            {
+                if (!(visit_if<Ts const>(seg, f) || ...))
+                {
+                    visit_segment<Base const>(seg, f);
+                }
+            }
+        }
+
+        // Removes all objects, keeping the segment storage
+        void clear() noexcept
+        {
+            for (auto& seg : segments_)
+            {
+                seg.vtable->destroy(seg.data, seg.size);
+                seg.size = 0;
+            }
+        }
+
+        template <typename U>
+        void reserve(std::size_t const capacity)
+        {
+            auto& seg = segment_for<U>();
+            if (capacity > seg.capacity)
+            {
+                auto* const new_data = seg.vtable->allocate(this->allocator(), capacity);
+                seg.vtable->relocate(seg.data, new_data, seg.size);
+                if (seg.capacity != 0)
+                {
+                    seg.vtable->deallocate(this->allocator(), seg.data, seg.capacity);
+                }
+                seg.data = new_data;
+                seg.capacity = capacity;
+            }
+        }
+
+        [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+        {
+            return this->allocator();
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            auto total = std::size_t{};
+            for (auto const& seg : segments_)
+            {
+                total += seg.size;
+            }
+            return total;
+        }
+
+        // Number of objects of exactly type U
+        template <typename U>
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            auto const* const seg = find_segment(segment_vtable::template get<U>());
+            return seg ? seg->size : 0;
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return size() == 0;
+        }
+
+        // Number of distinct types stored so far
+        [[nodiscard]] auto segment_count() const noexcept -> std::size_t
+        {
+            return segments_.size();
+        }
+
+      private:
+        std::vector<segment, segment_alloc> segments_;
+
+        [[nodiscard]] auto find_segment(segment_vtable const* const vtable) const noexcept -> segment const*
+        {
+            auto const iter = std::find_if(
+                segments_.begin(),
+                segments_.end(),
+                [=](segment const& seg) { return seg.vtable == vtable; });
+            return iter != segments_.end() ? &*iter : nullptr;
+        }
+
+        template <typename U>
+        [[nodiscard]] auto segment_for() -> segment&
+        {
+            auto const* const vtable = segment_vtable::template get<U>();
+            if (auto const* const seg = find_segment(vtable))
+            {
+                return const_cast<segment&>(*seg);
+            }
+            segments_.push_back(segment{vtable, nullptr, 0, 0, 0});
+            return segments_.back();
+        }
+
+        template <typename U, typename... Args>
+        void construct(segment& seg, void* const data, Args&&... args)
+        {
+            auto* const ptr = alloc_traits::template construct<U>(
+                this->allocator(),
+                static_cast<U*>(data) + seg.size,
+                std::forward<Args>(args)...);
+            seg.base_offset = reinterpret_cast<std::byte*>(static_cast<Base*>(ptr)) - reinterpret_cast<std::byte*>(ptr);
+        }
+
+        template <typename B, typename F>
+        static void visit_segment(segment const& seg, F& f)
+        {
+            auto* const first = static_cast<std::byte*>(seg.data) + seg.base_offset;
+            for (auto i = std::size_t{}; i < seg.size; ++i)
+            {
+                f(*std::launder(reinterpret_cast<B*>(first + i * seg.vtable->stride)));
+            }
+        }
+
+        template <typename U, typename F>
+        static auto visit_if(segment const& seg, F& f) -> bool
+        {
+            if (seg.vtable != segment_vtable::template get<std::remove_const_t<U>>())
+            {
+                return false;
+            }
+            auto* const first = std::launder(static_cast<U*>(seg.data));
+            for (auto i = std::size_t{}; i < seg.size; ++i)
+            {
+                f(first[i]);
+            }
+            return true;
+        }
+
+        void deallocate() noexcept
+        {
+            clear();
+            for (auto const& seg : segments_)
+            {
+                if (seg.capacity != 0)
+                {
+                    seg.vtable->deallocate(this->allocator(), seg.data, seg.capacity);
+                }
+            }
+            segments_.clear();
+        }
+
+        // Moves the segments of a collection with a different allocator
+        void move_segments_from(poly_collection& other)
+        {
+            segments_.reserve(other.segments_.size());
+            for (auto& seg : other.segments_)
+            {
+                auto* const data = seg.capacity != 0 ? seg.vtable->allocate(this->allocator(), seg.capacity) : nullptr;
+                seg.vtable->relocate(seg.data, data, seg.size);
+                if (seg.capacity != 0)
+                {
+                    seg.vtable->deallocate(other.allocator(), seg.data, seg.capacity);
+                }
+                segments_.push_back(segment{seg.vtable, data, seg.size, seg.capacity, seg.base_offset});
+                seg = segment{seg.vtable, nullptr, 0, 0, 0};
+            }
+        }
+    };
+
+    namespace pmr
+    {
+        template <typename Base>
+        using poly_collection = sboptr::poly_collection<Base, std::pmr::polymorphic_allocator<std::byte>>;
+    }  // namespace pmr
+}  // namespace sboptr
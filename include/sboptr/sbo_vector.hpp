@@ -0,0 +1,613 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "sboptr/sboptr.hpp"
+
+namespace sboptr
+{
+    namespace detail
+    {
+        // Parameter type of disabled copy operations
+        struct sbo_vector_nonesuch
+        {
+            sbo_vector_nonesuch() = delete;
+        };
+    }  // namespace detail
+
+    // Contiguous container of polymorphic objects.
+    // Objects live in fixed-stride inline slots, with their vtables kept in
+    // a parallel array, so iteration does not chase a pointer per element.
+    // Objects bigger than slot_size, or over-aligned for the slots, go to the heap,
+    // if allowed by the options.
+    template <typename T, std::size_t slot_size, sbo_ptr_options opts = movable | allow_heap, typename Allocator = default_allocator>
+    class sbo_vector : private detail::sbo_ptr_allocator_storage<detail::sbo_ptr_allocator_for_opts<opts, Allocator>>
+    {
+      public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using allocator_type = detail::sbo_ptr_allocator_for_opts<opts, Allocator>;
+
+      private:
+        using allocator_storage = detail::sbo_ptr_allocator_storage<allocator_type>;
+        using alloc_traits = detail::sbo_ptr_alloc_traits<allocator_type>;
+
+        static constexpr bool enable_copy = (opts & copyable) != 0;
+        static constexpr bool enable_heap = (opts & allow_heap) != 0;
+
+        using slot_type = std::aligned_storage_t<enable_heap ? std::max(slot_size, sizeof(T*)) : slot_size>;
+
+        // Slots use the compact layout: objects are found through the Base
+        // offset in the vtable, and heap objects keep their pointer in the slot
+        using storage = detail::sbo_ptr_storage<
+            T,
+            slot_size,
+            alignof(slot_type),
+            detail::sbo_ptr_vtable<T, true, enable_copy, enable_heap, allocator_type>,
+            enable_heap,
+            true>;
+        using vtable_type = typename storage::vtable_type;
+
+        using slot_alloc = typename alloc_traits::template rebind_alloc<slot_type>;
+        using slot_traits = typename alloc_traits::template rebind_traits<slot_type>;
+        using tag_alloc = typename alloc_traits::template rebind_alloc<std::uintptr_t>;
+        using tag_traits = typename alloc_traits::template rebind_traits<std::uintptr_t>;
+
+        static_assert(opts & movable, "Elements are moved when the vector grows, so they must be movable.");
+        static_assert(
+            !(opts & pooled) || detail::is_std_allocator<Allocator>::value,
+            "The pooled option provides its own allocator, it can not be combined with a custom one.");
+        static_assert(
+            (opts & (cow | budgeted | instrumented)) == 0,
+            "Vectors do not support the cow, budgeted and instrumented options.");
+
+        template <bool is_const>
+        class basic_iterator
+        {
+          public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<is_const, T const*, T*>;
+            using reference = std::conditional_t<is_const, T const&, T&>;
+
+            basic_iterator() noexcept = default;
+
+            basic_iterator(std::conditional_t<is_const, sbo_vector const*, sbo_vector*> const vector, std::size_t const index) noexcept
+              : vector_{vector},
+                index_{index}
+            {
+            }
+
+            // Conversion to const_iterator
+            template <bool c = is_const, typename = std::enable_if_t<c>>
+            basic_iterator(basic_iterator<false> const& other) noexcept
+              : vector_{other.vector_},
+                index_{other.index_}
+            {
+            }
+
+            [[nodiscard]] auto operator*() const noexcept -> reference
+            {
+                return *vector_->ptr_at(index_);
+            }
+
+            [[nodiscard]] auto operator->() const noexcept -> pointer
+            {
+                return vector_->ptr_at(index_);
+            }
+
+            auto operator++() noexcept -> basic_iterator&
+            {
+                ++index_;
+                return *this;
+            }
+
+            auto operator++(int) noexcept -> basic_iterator
+            {
+                auto const copy = *this;
+                ++index_;
+                return copy;
+            }
+
+            [[nodiscard]] friend auto operator==(basic_iterator const& lhs, basic_iterator const& rhs) noexcept -> bool
+            {
+                return lhs.index_ == rhs.index_;
+            }
+
+            [[nodiscard]] friend auto operator!=(basic_iterator const& lhs, basic_iterator const& rhs) noexcept -> bool
+            {
+                return !(lhs == rhs);
+            }
+
+          private:
+            friend class basic_iterator<true>;
+
+            std::conditional_t<is_const, sbo_vector const*, sbo_vector*> vector_ = nullptr;
+            std::size_t index_ = 0;
+        };
+
+      public:
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+
+        sbo_vector() noexcept = default;
+
+        explicit sbo_vector(allocator_type const& alloc) noexcept
+          : allocator_storage{alloc}
+        {
+        }
+
+        sbo_vector(std::conditional_t<enable_copy, sbo_vector, detail::sbo_vector_nonesuch> const& other)
+          : sbo_vector{
+              std::allocator_arg,
+              alloc_traits::traits::select_on_container_copy_construction(other.allocator()),
+              other,
+            }
+        {
+        }
+
+        // Delegating to a complete constructor, so the destructor cleans up if copying throws
+        sbo_vector(std::allocator_arg_t, allocator_type const& alloc, std::conditional_t<enable_copy, sbo_vector, detail::sbo_vector_nonesuch> const& other)
+          : sbo_vector{alloc}
+        {
+            reserve(other.size_);
+            for (; size_ < other.size_; ++size_)
+            {
+                copy_element(other, size_);
+            }
+        }
+
+        sbo_vector(sbo_vector&& other) noexcept
+          : allocator_storage{other.allocator()}
+        {
+            steal(other);
+        }
+
+        // Only throws if the allocators differ, and elements have to be moved between them
+        sbo_vector(std::allocator_arg_t, allocator_type const& alloc, sbo_vector&& other)
+          : sbo_vector{alloc}
+        {
+            if (alloc_traits::equal(this->allocator(), other.allocator()))
+            {
+                steal(other);
+            }
+            else
+            {
+                move_elements_from(other);
+            }
+        }
+
+        auto operator=(std::conditional_t<enable_copy, sbo_vector, detail::sbo_vector_nonesuch> const& other) -> sbo_vector&
+        {
+            if (this != &other)
+            {
+                // Strong exception guarantee
+                auto copy = sbo_vector{
+                    std::allocator_arg,
+                    alloc_traits::propagate_on_copy_assignment ? other.allocator() : this->allocator(),
+                    other,
+                };
+                deallocate();
+                if constexpr (alloc_traits::propagate_on_copy_assignment)
+                {
+                    this->allocator() = other.allocator();
+                }
+                steal(copy);
+            }
+            return *this;
+        }
+
+        auto operator=(sbo_vector&& other) noexcept(alloc_traits::propagate_on_move_assignment || alloc_traits::is_always_equal) -> sbo_vector&
+        {
+            if (this != &other)
+            {
+                deallocate();
+                if constexpr (alloc_traits::propagate_on_move_assignment)
+                {
+                    this->allocator() = other.allocator();
+                }
+                if (alloc_traits::equal(this->allocator(), other.allocator()))
+                {
+                    steal(other);
+                }
+                else
+                {
+                    move_elements_from(other);
+                }
+            }
+            return *this;
+        }
+
+        ~sbo_vector() noexcept
+        {
+            deallocate();
+        }
+
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<detail::can_emplace<T, opts, U, Args&&...>()>>
+        auto emplace_back(Args&&... args) -> U&
+        {
+            if (size_ == capacity_)
+            {
+                // The new element is constructed before the old ones are moved,
+                // so a throwing constructor leaves the vector unchanged
+                auto new_buffer = allocate(grown_capacity());
+                try
+                {
+                    construct_element<U>(new_buffer, size_, std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    deallocate_buffer(new_buffer);
+                    throw;
+                }
+                relocate_elements(new_buffer);
+            }
+            else
+            {
+                construct_element<U>(buffer{slots_, tags_, capacity_}, size_, std::forward<Args>(args)...);
+            }
+            return static_cast<U&>(*ptr_at(size_++));
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<detail::can_emplace<T, opts, std::decay_t<U>, U&&>()>>
+        auto push_back(U&& value) -> std::decay_t<U>&
+        {
+            return emplace_back<std::decay_t<U>>(std::forward<U>(value));
+        }
+
+        void pop_back() noexcept
+        {
+            destroy_element(--size_);
+        }
+
+        void clear() noexcept
+        {
+            while (size_ != 0)
+            {
+                destroy_element(--size_);
+            }
+        }
+
+        void reserve(std::size_t const new_capacity)
+        {
+            if (new_capacity > capacity_)
+            {
+                relocate_elements(allocate(new_capacity));
+            }
+        }
+
+        // Calls f with every element, in order
+        template <typename F>
+        void for_each(F&& f)
+        {
+            for (auto i = std::size_t{}; i < size_; ++i)
+            {
+                f(*ptr_at(i));
+            }
+        }
+
+        template <typename F>
+        void for_each(F&& f) const
+        {
+            for (auto i = std::size_t{}; i < size_; ++i)
+            {
+                f(*static_cast<T const*>(ptr_at(i)));
+            }
+        }
+
+        [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+        {
+            return this->allocator();
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            return size_;
+        }
+
+        [[nodiscard]] auto capacity() const noexcept -> std::size_t
+        {
+            return capacity_;
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return size_ == 0;
+        }
+
+        [[nodiscard]] auto operator[](std::size_t const index) noexcept -> T&
+        {
+            return *ptr_at(index);
+        }
+
+        [[nodiscard]] auto operator[](std::size_t const index) const noexcept -> T const&
+        {
+            return *ptr_at(index);
+        }
+
+        [[nodiscard]] auto front() noexcept -> T&
+        {
+            return *ptr_at(0);
+        }
+
+        [[nodiscard]] auto front() const noexcept -> T const&
+        {
+            return *ptr_at(0);
+        }
+
+        [[nodiscard]] auto back() noexcept -> T&
+        {
+            return *ptr_at(size_ - 1);
+        }
+
+        [[nodiscard]] auto back() const noexcept -> T const&
+        {
+            return *ptr_at(size_ - 1);
+        }
+
+        [[nodiscard]] auto begin() noexcept -> iterator
+        {
+            return {this, 0};
+        }
+
+        [[nodiscard]] auto begin() const noexcept -> const_iterator
+        {
+            return {this, 0};
+        }
+
+        [[nodiscard]] auto end() noexcept -> iterator
+        {
+            return {this, size_};
+        }
+
+        [[nodiscard]] auto end() const noexcept -> const_iterator
+        {
+            return {this, size_};
+        }
+
+      private:
+        struct buffer
+        {
+            slot_type* slots;
+            std::uintptr_t* tags;
+            std::size_t capacity;
+        };
+
+        slot_type* slots_ = nullptr;
+        // Vtables of the elements, tagged with heap_bit for heap objects
+        std::uintptr_t* tags_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t capacity_ = 0;
+
+        // Marks objects whose Base is not at the start of the slot,
+        // so the common case needs no vtable load to find the object
+        static constexpr auto offset_bit = std::uintptr_t{2};
+        static constexpr auto tag_bits = detail::heap_bit | offset_bit;
+
+        static_assert(alignof(vtable_type) > tag_bits);
+
+        [[nodiscard]] static auto vtable_of(std::uintptr_t const tag) noexcept -> vtable_type const*
+        {
+            return reinterpret_cast<vtable_type const*>(tag & ~tag_bits);
+        }
+
+        template <typename U>
+        [[nodiscard]] static auto tag_of(U* const ptr, bool const is_on_heap) noexcept -> std::uintptr_t
+        {
+            auto const* const vtable = storage::template vtable_for<U>(ptr);
+            auto const tag = detail::tag_vtable(vtable, is_on_heap);
+            return !is_on_heap && vtable->base_offset != 0 ? tag | offset_bit : tag;
+        }
+
+        [[nodiscard]] static auto is_on_heap(std::uintptr_t const tag) noexcept -> bool
+        {
+            return enable_heap && (tag & detail::heap_bit) != 0;
+        }
+
+        [[nodiscard]] auto ptr_at(std::size_t const index) const noexcept -> T*
+        {
+            auto const tag = tags_[index];
+            auto* const slot = reinterpret_cast<std::byte*>(const_cast<slot_type*>(slots_ + index));
+            if ((tag & tag_bits) == 0)
+            {
+                return std::launder(reinterpret_cast<T*>(slot));
+            }
+            if (is_on_heap(tag))
+            {
+                return *std::launder(reinterpret_cast<T**>(slot));
+            }
+            return std::launder(reinterpret_cast<T*>(slot + vtable_of(tag)->base_offset));
+        }
+
+        [[nodiscard]] auto grown_capacity() const noexcept -> std::size_t
+        {
+            return capacity_ == 0 ? 4 : capacity_ * 2;
+        }
+
+        [[nodiscard]] auto allocate(std::size_t const capacity) -> buffer
+        {
+            auto slots = slot_alloc{this->allocator()};
+            auto tags = tag_alloc{this->allocator()};
+            auto* const new_slots = slot_traits::allocate(slots, capacity);
+            try
+            {
+                return {new_slots, tag_traits::allocate(tags, capacity), capacity};
+            }
+            catch (...)
+            {
+                slot_traits::deallocate(slots, new_slots, capacity);
+                throw;
+            }
+        }
+
+        void deallocate_buffer(buffer const& buffer) noexcept
+        {
+            if (buffer.capacity != 0)
+            {
+                auto slots = slot_alloc{this->allocator()};
+                auto tags = tag_alloc{this->allocator()};
+                slot_traits::deallocate(slots, buffer.slots, buffer.capacity);
+                tag_traits::deallocate(tags, buffer.tags, buffer.capacity);
+            }
+        }
+
+        // Destroys all elements and frees the storage
+        void deallocate() noexcept
+        {
+            clear();
+            deallocate_buffer({slots_, tags_, capacity_});
+            slots_ = nullptr;
+            tags_ = nullptr;
+            capacity_ = 0;
+        }
+
+        void steal(sbo_vector& other) noexcept
+        {
+            slots_ = std::exchange(other.slots_, nullptr);
+            tags_ = std::exchange(other.tags_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+
+        // Moves the elements into the given buffer, which becomes the new storage
+        void relocate_elements(buffer const& to) noexcept
+        {
+            if constexpr ((opts & trivially_relocatable) != 0)
+            {
+                if (size_ != 0)
+                {
+                    std::memcpy(to.slots, slots_, size_ * sizeof(slot_type));
+                }
+            }
+            else
+            {
+                for (auto i = std::size_t{}; i < size_; ++i)
+                {
+                    auto const tag = tags_[i];
+                    if (is_on_heap(tag) || vtable_of(tag)->trivially_relocatable)
+                    {
+                        std::memcpy(to.slots + i, slots_ + i, sizeof(slot_type));
+                    }
+                    else
+                    {
+                        vtable_of(tag)->move(slots_ + i, to.slots + i);
+                    }
+                }
+            }
+            if (size_ != 0)
+            {
+                std::memcpy(to.tags, tags_, size_ * sizeof(std::uintptr_t));
+            }
+            deallocate_buffer({slots_, tags_, capacity_});
+            slots_ = to.slots;
+            tags_ = to.tags;
+            capacity_ = to.capacity;
+        }
+
+        // Moves the elements of a vector with a different allocator one by one
+        void move_elements_from(sbo_vector& other)
+        {
+            reserve(other.size_);
+            try
+            {
+                for (; size_ < other.size_; ++size_)
+                {
+                    auto const tag = other.tags_[size_];
+                    if (is_on_heap(tag))
+                    {
+                        if constexpr (enable_heap)
+                        {
+                            auto* const ptr = vtable_of(tag)->heap_move(other.ptr_at(size_), other.allocator(), this->allocator());
+                            new (slots_ + size_) T*(ptr);
+                        }
+                    }
+                    else
+                    {
+                        vtable_of(tag)->move(other.slots_ + size_, slots_ + size_);
+                    }
+                    tags_[size_] = tag;
+                }
+            }
+            catch (...)
+            {
+                // The moved elements are gone from other, drop the rest as well
+                while (other.size_ != size_)
+                {
+                    other.destroy_element(--other.size_);
+                }
+                other.size_ = 0;
+                throw;
+            }
+            other.size_ = 0;
+        }
+
+        template <typename U, typename... Args>
+        void construct_element(buffer const& to, std::size_t const index, Args&&... args)
+        {
+            if constexpr (detail::fits_buffer<U, slot_size, alignof(slot_type)>)
+            {
+                auto* const ptr = alloc_traits::template construct<U>(this->allocator(), to.slots + index, std::forward<Args>(args)...);
+                to.tags[index] = tag_of(ptr, false);
+            }
+            else
+            {
+                static_assert(
+                    enable_heap,
+                    "Derived class is too big or over-aligned for the slots. Increase the slot size or allow heap allocations.");
+
+                auto* const ptr = alloc_traits::template heap_new<U>(this->allocator(), std::forward<Args>(args)...);
+                new (to.slots + index) T*(ptr);
+                to.tags[index] = tag_of(ptr, true);
+            }
+        }
+
+        void copy_element(sbo_vector const& other, std::size_t const index)
+        {
+            auto const tag = other.tags_[index];
+            if (is_on_heap(tag))
+            {
+                if constexpr (enable_heap)
+                {
+                    auto* const ptr = vtable_of(tag)->heap_copy(other.ptr_at(index), this->allocator());
+                    new (slots_ + index) T*(ptr);
+                }
+            }
+            else
+            {
+                vtable_of(tag)->copy(other.slots_ + index, slots_ + index, this->allocator());
+            }
+            tags_[index] = tag;
+        }
+
+        void destroy_element(std::size_t const index) noexcept
+        {
+            auto* const ptr = ptr_at(index);
+            if (!is_on_heap(tags_[index]))
+            {
+                detail::destroy_in_place(vtable_of(tags_[index]), ptr);
+            }
+            else if constexpr (enable_heap)
+            {
+                vtable_of(tags_[index])->heap_delete(ptr, this->allocator());
+            }
+        }
+    };
+
+    namespace pmr
+    {
+        template <typename T, std::size_t slot_size, sbo_ptr_options opts = movable | allow_heap>
+        using sbo_vector = sboptr::sbo_vector<T, slot_size, opts, std::pmr::polymorphic_allocator<std::byte>>;
+    }  // namespace pmr
+}  // namespace sboptr
@@ -1,9 +1,38 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string_view>
 #include <type_traits>
+#include <typeinfo>
 #include <utility>
+#include <vector>
+
+// With C++20, the types listed in the _for aliases are constructed in members
+// of the small buffer, so pointers holding them can be constant-initialized.
+#if defined(__cpp_lib_constexpr_dynamic_alloc) && defined(__cpp_constexpr_dynamic_alloc)
+#define SBOPTR_HAS_CONSTEXPR_CONSTRUCTION 1
+#define SBOPTR_CONSTEXPR20 constexpr
+#else
+#define SBOPTR_CONSTEXPR20
+#endif
+
+// Checks preconditions, by default in debug builds only. May be defined
+// before the header is included, to report violations some other way.
+#ifndef SBOPTR_ASSERT
+#define SBOPTR_ASSERT(condition) assert(condition)
+#endif
 
 namespace sboptr
 {
@@ -13,714 +42,2715 @@ namespace sboptr
     inline constexpr auto movable = sbo_ptr_options{1u << 0u};
     inline constexpr auto copyable = sbo_ptr_options{1u << 1u};
     inline constexpr auto allow_heap = sbo_ptr_options{1u << 2u};
+    inline constexpr auto pooled = sbo_ptr_options{1u << 3u};
+    inline constexpr auto trivially_relocatable = sbo_ptr_options{1u << 4u};
+    inline constexpr auto compact = sbo_ptr_options{1u << 5u};
+    inline constexpr auto instrumented = sbo_ptr_options{1u << 6u};
+    inline constexpr auto cache_aligned = sbo_ptr_options{1u << 7u};
+    // Reference counts of shared_sbo_ptr are plain integers
+    inline constexpr auto non_atomic = sbo_ptr_options{1u << 8u};
+    inline constexpr auto cow = sbo_ptr_options{1u << 9u};
+    // Heap objects are charged to a heap_budget
+    inline constexpr auto budgeted = sbo_ptr_options{1u << 10u};
+
+    // Alignment of pointers with the cache_aligned option. The standard value
+    // may change with -mtune, so define SBOPTR_CACHE_LINE_SIZE to keep the
+    // layout the same in code built with different flags.
+#if defined(SBOPTR_CACHE_LINE_SIZE)
+    inline constexpr std::size_t cache_line_size = SBOPTR_CACHE_LINE_SIZE;
+#elif defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+    inline constexpr std::size_t cache_line_size = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+    inline constexpr std::size_t cache_line_size = 64;
+#endif
+
+    // A type is trivially relocatable if moving it to a new address
+    // and destroying the original is equivalent to copying its bytes
+    // (the P1144 notion). Polymorphic types are never trivially copyable,
+    // so specialize this for implementation classes known to qualify.
+    template <typename T>
+    struct is_trivially_relocatable : std::is_trivially_copyable<T>
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+    // A type is bitwise copyable if a copy of the bytes of a live object
+    // is an equivalent object, copying it reads nothing outside of it
+    // (no owned pointers, no references to the original), and its
+    // destructor has no effect. Like is_trivially_relocatable,
+    // specialize this for polymorphic implementation classes that qualify.
+    template <typename T>
+    struct is_bitwise_copyable : std::is_trivially_copyable<T>
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool is_bitwise_copyable_v = is_bitwise_copyable<T>::value;
+
+    // Operations stored in the vtables of pointers to T, next to the special
+    // member functions, and returned by ops(). Specialize this with function
+    // pointer members and a static create<Derived>() that fills them in.
+    template <typename T>
+    struct sbo_ptr_operations
+    {
+        template <typename Derived>
+        static constexpr auto create() noexcept -> sbo_ptr_operations
+        {
+            return {};
+        }
+    };
+
+    // Element type of pointers to objects of unrelated types, which are
+    // used only through the operations in Ops (external polymorphism).
+    // Ops has the same form as a specialization of sbo_ptr_operations,
+    // and get() returns void*.
+    template <typename Ops>
+    struct external
+    {
+        external() = delete;
+    };
+
+    using default_allocator = std::allocator<std::byte>;
+
+    struct pool_stats
+    {
+        // Allocations served from the thread cache
+        std::size_t hits = 0;
+        // Allocations that had to go to operator new
+        std::size_t misses = 0;
+        // Allocations too big or too over-aligned for any size class
+        std::size_t oversize = 0;
+        // Full magazines taken from / handed over to the shared depot
+        std::size_t depot_imports = 0;
+        std::size_t depot_exports = 0;
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        struct is_external : std::false_type
+        {
+        };
+
+        template <typename Ops>
+        struct is_external<external<Ops>> : std::true_type
+        {
+        };
+
+        template <typename Base>
+        struct operations_of
+        {
+            using type = sbo_ptr_operations<Base>;
+        };
+
+        template <typename Ops>
+        struct operations_of<external<Ops>>
+        {
+            using type = Ops;
+        };
+
+        template <typename Base>
+        using operations_t = typename operations_of<Base>::type;
+
+        // Conversions between the stored objects and the Base pointers kept for them.
+        // External objects have no Base subobject; their address is kept, and they
+        // are only accessed as Derived.
+        template <typename Base, typename Derived>
+        [[nodiscard]] constexpr auto to_base(Derived* const object) noexcept -> Base*
+        {
+            if constexpr (is_external<Base>::value)
+            {
+                return reinterpret_cast<Base*>(object);
+            }
+            else
+            {
+                return object;
+            }
+        }
+
+        template <typename Derived, typename Base>
+        [[nodiscard]] auto to_derived(Base* const ptr) noexcept -> Derived*
+        {
+            if constexpr (is_external<std::remove_const_t<Base>>::value)
+            {
+                return reinterpret_cast<Derived*>(ptr);
+            }
+            else
+            {
+                return static_cast<Derived*>(ptr);
+            }
+        }
+
+        // Whether object is not a subobject of a more derived type.
+        // Only checked for polymorphic types, and only with RTTI.
+        template <typename T>
+        [[nodiscard]] auto is_most_derived(T const& object) noexcept -> bool
+        {
+#if defined(__cpp_rtti) || defined(_CPPRTTI)
+            if constexpr (std::is_polymorphic_v<T>)
+            {
+                return typeid(object) == typeid(T);
+            }
+#endif
+            static_cast<void>(object);
+            return true;
+        }
+
+        template <typename T>
+        struct is_in_place_type : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_in_place_type<std::in_place_type_t<T>> : std::true_type
+        {
+        };
+
+        // The requirements the standard containers use to tell allocators apart
+        template <typename T, typename = void>
+        struct is_allocator : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_allocator<T, std::void_t<typename T::value_type, decltype(std::declval<T&>().allocate(std::size_t{}))>>
+          : std::true_type
+        {
+        };
+
+        // Specialized for the pointer types (basic_sbo_ptr, shared_sbo_ptr)
+        template <typename T>
+        struct is_sbo_ptr : std::false_type
+        {
+        };
+
+        // Types that can be held by a pointer to Base. External pointers take
+        // any object, except the arguments of their other constructors:
+        // allocators and pointers are not stored, but passed on or converted.
+        template <typename Base, typename Derived>
+        inline constexpr bool is_storable = is_external<Base>::value
+                                                ? std::is_object_v<Derived> && !std::is_array_v<Derived> && !is_external<Derived>::value
+                                                      && !is_in_place_type<Derived>::value && !std::is_same_v<Derived, std::allocator_arg_t>
+                                                      && !std::is_same_v<Derived, std::nullptr_t> && !is_allocator<Derived>::value
+                                                      && !is_sbo_ptr<Derived>::value
+                                                : std::is_convertible_v<Derived*, Base*>;
+
+        // Size-class pool for heap fallback allocations.
+        // Each thread caches free blocks in two magazines per size class;
+        // when both run empty (or full), a whole magazine is exchanged
+        // with the shared depot, so blocks freed on other threads find
+        // their way back without per-block synchronization.
+        class size_class_pool
+        {
+          public:
+            static constexpr std::size_t granularity = 16;
+            static constexpr std::size_t max_size = 1024;
+            static constexpr std::size_t num_classes = max_size / granularity;
+            static constexpr std::size_t magazine_capacity = 32;
+
+            [[nodiscard]] static auto allocate(std::size_t const size, std::size_t const alignment) -> void*
+            {
+                auto* const cache = thread_cache();
+                if (!is_pooled(size, alignment))
+                {
+                    if (cache)
+                    {
+                        ++cache->stats.oversize;
+                    }
+                    return allocate_block(size, alignment);
+                }
+
+                // Always the full class size, even without a cache: the block
+                // may be freed into the cache of another thread, and handed out
+                // from there for any size of the class.
+                auto const size_class = class_of(size);
+                if (!cache)
+                {
+                    return allocate_block(class_size(size_class), alignment);
+                }
+
+                if (auto* const block = cache->pop(size_class))
+                {
+                    ++cache->stats.hits;
+                    return block;
+                }
+
+                ++cache->stats.misses;
+                return allocate_block(class_size(size_class), alignment);
+            }
+
+            static void deallocate(void* const block, std::size_t const size, std::size_t const alignment) noexcept
+            {
+                auto* const cache = thread_cache();
+                if (!is_pooled(size, alignment))
+                {
+                    deallocate_block(block, alignment);
+                }
+                else if (!cache || !cache->push(class_of(size), block))
+                {
+                    deallocate_block(block, alignment);
+                }
+            }
+
+            // Blocks of the same size are interchangeable
+            [[nodiscard]] static constexpr auto block_size(std::size_t const size, std::size_t const alignment) noexcept -> std::size_t
+            {
+                return is_pooled(size, alignment) ? class_size(class_of(size)) : size;
+            }
+
+            [[nodiscard]] static auto stats() noexcept -> pool_stats
+            {
+                auto* const cache = thread_cache();
+                return cache ? cache->stats : pool_stats{};
+            }
+
+            static void reset_stats() noexcept
+            {
+                if (auto* const cache = thread_cache())
+                {
+                    cache->stats = {};
+                }
+            }
+
+          private:
+            struct magazine
+            {
+                magazine* next = nullptr;
+                std::size_t count = 0;
+                void* blocks[magazine_capacity];
+            };
+
+            struct depot
+            {
+                std::mutex mutex;
+                magazine* full = nullptr;
+                magazine* empty = nullptr;
+
+                // Exchanges an empty (or no) magazine for a full one, if there is any
+                auto exchange_empty(magazine* const mag) noexcept -> magazine*
+                {
+                    auto const lock = std::lock_guard{mutex};
+                    if (!full)
+                    {
+                        return nullptr;
+                    }
+                    auto* const result = std::exchange(full, full->next);
+                    if (mag)
+                    {
+                        mag->next = std::exchange(empty, mag);
+                    }
+                    return result;
+                }
+
+                // Exchanges a full magazine for an empty one, if there is any
+                auto exchange_full(magazine* const mag) noexcept -> magazine*
+                {
+                    auto const lock = std::lock_guard{mutex};
+                    mag->next = std::exchange(full, mag);
+                    return empty ? std::exchange(empty, empty->next) : nullptr;
+                }
+
+                void put(magazine* const mag) noexcept
+                {
+                    auto const lock = std::lock_guard{mutex};
+                    if (mag->count)
+                    {
+                        mag->next = std::exchange(full, mag);
+                    }
+                    else
+                    {
+                        mag->next = std::exchange(empty, mag);
+                    }
+                }
+            };
+
+            struct thread_cache_t
+            {
+                magazine* loaded[num_classes] = {};
+                magazine* previous[num_classes] = {};
+                pool_stats stats;
+
+                thread_cache_t() noexcept = default;
+                thread_cache_t(thread_cache_t const&) = delete;
+                auto operator=(thread_cache_t const&) = delete;
+
+                ~thread_cache_t() noexcept
+                {
+                    thread_cache_destroyed() = true;
+                    for (auto size_class = std::size_t{}; size_class < num_classes; ++size_class)
+                    {
+                        for (auto* const mag : {loaded[size_class], previous[size_class]})
+                        {
+                            if (mag)
+                            {
+                                depots()[size_class].put(mag);
+                            }
+                        }
+                    }
+                }
+
+                auto pop(std::size_t const size_class) noexcept -> void*
+                {
+                    auto*& mag = loaded[size_class];
+                    if (!mag || !mag->count)
+                    {
+                        auto*& prev = previous[size_class];
+                        if (prev && prev->count)
+                        {
+                            std::swap(mag, prev);
+                        }
+                        else if (auto* const full = depots()[size_class].exchange_empty(mag))
+                        {
+                            mag = full;
+                            ++stats.depot_imports;
+                        }
+                        else
+                        {
+                            return nullptr;
+                        }
+                    }
+                    return mag->blocks[--mag->count];
+                }
+
+                auto push(std::size_t const size_class, void* const block) noexcept -> bool
+                {
+                    auto*& mag = loaded[size_class];
+                    if (!mag || mag->count == magazine_capacity)
+                    {
+                        auto*& prev = previous[size_class];
+                        if (!mag)
+                        {
+                            mag = new (std::nothrow) magazine{};
+                            if (!mag)
+                            {
+                                return false;
+                            }
+                        }
+                        else if (!prev || prev->count < magazine_capacity)
+                        {
+                            std::swap(mag, prev);
+                            if (!mag)
+                            {
+                                mag = new (std::nothrow) magazine{};
+                                if (!mag)
+                                {
+                                    mag = std::exchange(prev, nullptr);
+                                    return false;
+                                }
+                            }
+                        }
+                        else
+                        {
+                            auto* const empty = depots()[size_class].exchange_full(mag);
+                            ++stats.depot_exports;
+                            mag = empty ? empty : new (std::nothrow) magazine{};
+                            if (!mag)
+                            {
+                                return false;
+                            }
+                        }
+                    }
+                    mag->blocks[mag->count++] = block;
+                    return true;
+                }
+            };
+
+            [[nodiscard]] static constexpr auto is_pooled(std::size_t const size, std::size_t const alignment) noexcept -> bool
+            {
+                return size <= max_size && alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+            }
+
+            [[nodiscard]] static constexpr auto class_of(std::size_t const size) noexcept -> std::size_t
+            {
+                return size ? (size - 1) / granularity : 0;
+            }
+
+            [[nodiscard]] static constexpr auto class_size(std::size_t const size_class) noexcept -> std::size_t
+            {
+                return (size_class + 1) * granularity;
+            }
+
+            [[nodiscard]] static auto allocate_block(std::size_t const size, std::size_t const alignment) -> void*
+            {
+                if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                {
+                    return ::operator new(size, std::align_val_t{alignment});
+                }
+                return ::operator new(size);
+            }
+
+            static void deallocate_block(void* const block, std::size_t const alignment) noexcept
+            {
+                if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                {
+                    ::operator delete(block, std::align_val_t{alignment});
+                }
+                else
+                {
+                    ::operator delete(block);
+                }
+            }
+
+            [[nodiscard]] static auto depots() noexcept -> depot*
+            {
+                // Intentionally leaked, so that objects destroyed during static
+                // destruction can still return their memory.
+                static auto* const instance = new depot[num_classes];
+                return instance;
+            }
+
+            [[nodiscard]] static auto thread_cache_destroyed() noexcept -> bool&
+            {
+                static thread_local auto destroyed = false;
+                return destroyed;
+            }
+
+            [[nodiscard]] static auto thread_cache() noexcept -> thread_cache_t*
+            {
+                // After the cache of an exiting thread is gone,
+                // the remaining deallocations bypass the pool.
+                if (thread_cache_destroyed())
+                {
+                    return nullptr;
+                }
+                static thread_local auto cache = thread_cache_t{};
+                return &cache;
+            }
+        };
+    }  // namespace detail
+
+    // Statistics of the size-class pool, for the calling thread
+    [[nodiscard]] inline auto get_pool_stats() noexcept -> pool_stats
+    {
+        return detail::size_class_pool::stats();
+    }
+
+    inline void reset_pool_stats() noexcept
+    {
+        detail::size_class_pool::reset_stats();
+    }
+
+    // Stateless allocator using the size-class pool.
+    // Used in place of the default allocator by pointers with the pooled option.
+    template <typename T>
+    class pool_allocator
+    {
+      public:
+        using value_type = T;
+        using is_always_equal = std::true_type;
+
+        pool_allocator() noexcept = default;
+
+        template <typename U>
+        pool_allocator(pool_allocator<U> const&) noexcept
+        {
+        }
+
+        [[nodiscard]] auto allocate(std::size_t const n) -> T*
+        {
+            if (n > std::size_t(-1) / sizeof(T))
+            {
+                throw std::bad_array_new_length{};
+            }
+            return static_cast<T*>(detail::size_class_pool::allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* const ptr, std::size_t const n) noexcept
+        {
+            detail::size_class_pool::deallocate(ptr, n * sizeof(T), alignof(T));
+        }
+
+        template <typename U>
+        [[nodiscard]] friend auto operator==(pool_allocator const&, pool_allocator<U> const&) noexcept -> bool
+        {
+            return true;
+        }
+
+        template <typename U>
+        [[nodiscard]] friend auto operator!=(pool_allocator const&, pool_allocator<U> const&) noexcept -> bool
+        {
+            return false;
+        }
+    };
+
+    // Heap fallback statistics of one Derived type, collected by pointers
+    // with the instrumented option, or by all pointers with heap fallback
+    // if SBOPTR_HEAP_FALLBACK_STATS is defined.
+    struct heap_fallback_stats
+    {
+        // Name of the Derived type, as spelled by the compiler
+        std::string_view type;
+        std::size_t size = 0;
+        // Objects constructed in the small buffer / on the heap
+        std::size_t inline_constructions = 0;
+        std::size_t heap_constructions = 0;
+        // Bytes allocated for heap objects, including copies
+        std::size_t heap_bytes = 0;
+        std::size_t copies = 0;
+        std::size_t moves = 0;
+    };
+
+    namespace detail
+    {
+#ifdef SBOPTR_HEAP_FALLBACK_STATS
+        inline constexpr bool instrument_all = true;
+#else
+        inline constexpr bool instrument_all = false;
+#endif
+
+        template <sbo_ptr_options opts>
+        inline constexpr bool is_instrumented = instrument_all || (opts & instrumented) != 0;
+
+        template <typename T>
+        constexpr auto type_name() noexcept -> std::string_view
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            constexpr auto signature = std::string_view{__FUNCSIG__};
+            constexpr auto first = signature.find("type_name<") + 10;
+            constexpr auto last = signature.rfind(">(void)");
+#else
+            constexpr auto signature = std::string_view{__PRETTY_FUNCTION__};
+            constexpr auto first = signature.find("T = ") + 4;
+            constexpr auto last = signature.find_first_of(";]", first);
+#endif
+            return signature.substr(first, last - first);
+        }
+
+        // Counters of one Derived type. A record links itself into the
+        // global list when first counted, so types never stored in an
+        // instrumented pointer do not show up.
+        class heap_fallback_record
+        {
+          public:
+            constexpr heap_fallback_record(std::string_view const type, std::size_t const size) noexcept
+              : type_{type},
+                size_{size}
+            {
+            }
+
+            void count_construction(bool const on_heap) noexcept
+            {
+                link();
+                if (on_heap)
+                {
+                    heap_constructions_.fetch_add(1, std::memory_order_relaxed);
+                    heap_bytes_.fetch_add(size_, std::memory_order_relaxed);
+                }
+                else
+                {
+                    inline_constructions_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            void count_copy(bool const on_heap) noexcept
+            {
+                link();
+                copies_.fetch_add(1, std::memory_order_relaxed);
+                if (on_heap)
+                {
+                    heap_bytes_.fetch_add(size_, std::memory_order_relaxed);
+                }
+            }
+
+            // Heap objects are only reallocated when moved between allocators
+            void count_move(bool const reallocated) noexcept
+            {
+                link();
+                moves_.fetch_add(1, std::memory_order_relaxed);
+                if (reallocated)
+                {
+                    heap_bytes_.fetch_add(size_, std::memory_order_relaxed);
+                }
+            }
+
+            [[nodiscard]] auto snapshot() const noexcept -> heap_fallback_stats
+            {
+                return {
+                    type_,
+                    size_,
+                    inline_constructions_.load(std::memory_order_relaxed),
+                    heap_constructions_.load(std::memory_order_relaxed),
+                    heap_bytes_.load(std::memory_order_relaxed),
+                    copies_.load(std::memory_order_relaxed),
+                    moves_.load(std::memory_order_relaxed),
+                };
+            }
+
+            void reset() noexcept
+            {
+                inline_constructions_.store(0, std::memory_order_relaxed);
+                heap_constructions_.store(0, std::memory_order_relaxed);
+                heap_bytes_.store(0, std::memory_order_relaxed);
+                copies_.store(0, std::memory_order_relaxed);
+                moves_.store(0, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] static auto first() noexcept -> heap_fallback_record*
+            {
+                return head().load(std::memory_order_acquire);
+            }
+
+            [[nodiscard]] auto next() const noexcept -> heap_fallback_record*
+            {
+                return next_;
+            }
+
+          private:
+            std::string_view type_;
+            std::size_t size_;
+            std::atomic<std::size_t> inline_constructions_{};
+            std::atomic<std::size_t> heap_constructions_{};
+            std::atomic<std::size_t> heap_bytes_{};
+            std::atomic<std::size_t> copies_{};
+            std::atomic<std::size_t> moves_{};
+            std::atomic<bool> linked_{};
+            heap_fallback_record* next_ = nullptr;
+
+            [[nodiscard]] static auto head() noexcept -> std::atomic<heap_fallback_record*>&
+            {
+                static auto instance = std::atomic<heap_fallback_record*>{};
+                return instance;
+            }
+
+            void link() noexcept
+            {
+                if (!linked_.load(std::memory_order_relaxed) && !linked_.exchange(true, std::memory_order_relaxed))
+                {
+                    next_ = head().load(std::memory_order_relaxed);
+                    while (!head().compare_exchange_weak(next_, this, std::memory_order_release, std::memory_order_relaxed))
+                    {
+                    }
+                }
+            }
+        };
+
+        // Constant initialized and trivially destructible,
+        // so it can be counted and reported at any time
+        template <typename Derived>
+        inline auto heap_fallback_record_for = heap_fallback_record{type_name<Derived>(), sizeof(Derived)};
+
+        inline auto heap_fallback_report_file = std::atomic<std::FILE*>{};
+    }  // namespace detail
+
+    // Statistics of all Derived types stored in instrumented pointers so far.
+    // The counters of a type are read one by one, so they may be slightly
+    // inconsistent while other threads keep using pointers.
+    [[nodiscard]] inline auto get_heap_fallback_stats() -> std::vector<heap_fallback_stats>
+    {
+        auto stats = std::vector<heap_fallback_stats>{};
+        for (auto const* record = detail::heap_fallback_record::first(); record; record = record->next())
+        {
+            stats.push_back(record->snapshot());
+        }
+        return stats;
+    }
+
+    inline void reset_heap_fallback_stats() noexcept
+    {
+        for (auto* record = detail::heap_fallback_record::first(); record; record = record->next())
+        {
+            record->reset();
+        }
+    }
+
+    // Writes one line per Derived type, those using the most heap memory first
+    inline void print_heap_fallback_stats(std::FILE* const out)
+    {
+        auto stats = get_heap_fallback_stats();
+        std::sort(stats.begin(), stats.end(), [](heap_fallback_stats const& lhs, heap_fallback_stats const& rhs) {
+            return lhs.heap_bytes > rhs.heap_bytes;
+        });
+
+        std::fprintf(out, "sboptr heap fallback statistics:\n");
+        for (auto const& s : stats)
+        {
+            std::fprintf(
+                out,
+                "  %.*s (%zu bytes): %zu inline, %zu heap, %zu heap bytes, %zu copies, %zu moves\n",
+                static_cast<int>(s.type.size()),
+                s.type.data(),
+                s.size,
+                s.inline_constructions,
+                s.heap_constructions,
+                s.heap_bytes,
+                s.copies,
+                s.moves);
+        }
+    }
+
+    // Prints the statistics when the program exits normally.
+    // Calling it again only changes the output file.
+    inline void report_heap_fallback_stats_at_exit(std::FILE* const out = stderr)
+    {
+        if (detail::heap_fallback_report_file.exchange(out) == nullptr)
+        {
+            std::atexit([] { print_heap_fallback_stats(detail::heap_fallback_report_file.load()); });
+        }
+    }
+
+    // Limit on the bytes of heap objects of pointers with the budgeted option.
+    // Objects are charged to the budget of the thread constructing them: the
+    // global one, unless the thread installed its own with heap_budget_scope.
+    // Copies are charged like constructions, moved objects keep their budget.
+    class heap_budget
+    {
+      public:
+        static constexpr auto unlimited = ~std::size_t{};
+
+        constexpr heap_budget() noexcept = default;
+
+        constexpr explicit heap_budget(std::size_t const limit) noexcept
+          : limit_{limit}
+        {
+        }
+
+        heap_budget(heap_budget const&) = delete;
+        auto operator=(heap_budget const&) -> heap_budget& = delete;
+
+        // Lowering the limit below the usage only fails further charges
+        void set_limit(std::size_t const limit) noexcept
+        {
+            limit_.store(limit, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] auto limit() const noexcept -> std::size_t
+        {
+            return limit_.load(std::memory_order_relaxed);
+        }
+
+        // Bytes of the heap objects currently charged
+        [[nodiscard]] auto used() const noexcept -> std::size_t
+        {
+            return used_.load(std::memory_order_relaxed);
+        }
+
+        // Charges bytes, unless that would exceed the limit
+        [[nodiscard]] auto try_acquire(std::size_t const bytes) noexcept -> bool
+        {
+            auto used = used_.load(std::memory_order_relaxed);
+            do
+            {
+                if (bytes > limit() || used > limit() - bytes)
+                {
+                    return false;
+                }
+            } while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+            return true;
+        }
+
+        void release(std::size_t const bytes) noexcept
+        {
+            used_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        // Unlimited, unless a limit is set
+        [[nodiscard]] static auto global() noexcept -> heap_budget&
+        {
+            static auto instance = heap_budget{};
+            return instance;
+        }
+
+        // The budget charged by this thread
+        [[nodiscard]] static auto current() noexcept -> heap_budget&;
+
+      private:
+        std::atomic<std::size_t> limit_{unlimited};
+        std::atomic<std::size_t> used_{};
+    };
+
+    namespace detail
+    {
+        inline thread_local heap_budget* thread_heap_budget = nullptr;
+    }  // namespace detail
+
+    inline auto heap_budget::current() noexcept -> heap_budget&
+    {
+        auto* const budget = detail::thread_heap_budget;
+        return budget ? *budget : global();
+    }
+
+    // Makes this thread charge budget instead of the previous one, until destroyed.
+    // The budget has to outlive the heap objects charged to it.
+    class heap_budget_scope
+    {
+      public:
+        explicit heap_budget_scope(heap_budget& budget) noexcept
+          : previous_{std::exchange(detail::thread_heap_budget, &budget)}
+        {
+        }
+
+        heap_budget_scope(heap_budget_scope const&) = delete;
+        auto operator=(heap_budget_scope const&) -> heap_budget_scope& = delete;
+
+        ~heap_budget_scope() noexcept
+        {
+            detail::thread_heap_budget = previous_;
+        }
+
+      private:
+        heap_budget* previous_;
+    };
+
+    // Result of try_emplace. The pointer is only changed on success.
+    enum class emplace_status
+    {
+        success,
+        // The heap object would exceed the heap_budget of the thread
+        over_budget,
+        out_of_memory,
+    };
+
+    namespace detail
+    {
+        template <typename Allocator>
+        struct is_std_allocator : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_std_allocator<std::allocator<T>> : std::true_type
+        {
+        };
+
+        // Class-specific allocation functions, which the default allocator honours
+        template <typename T, typename = void>
+        struct has_class_allocation : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct has_class_allocation<T, std::void_t<decltype(T::operator new(std::size_t{}))>> : std::true_type
+        {
+        };
+
+        template <typename Allocator>
+        struct sbo_ptr_alloc_traits
+        {
+            using traits = std::allocator_traits<Allocator>;
+
+            // With std::allocator we keep using plain new / delete expressions,
+            // so class-specific allocation functions of the stored types are honoured.
+            static constexpr bool is_default = is_std_allocator<Allocator>::value;
+
+            static constexpr bool propagate_on_copy_assignment = traits::propagate_on_container_copy_assignment::value;
+            static constexpr bool propagate_on_move_assignment = traits::propagate_on_container_move_assignment::value;
+            static constexpr bool is_always_equal = traits::is_always_equal::value;
+
+            template <typename Derived>
+            using rebind_traits = typename traits::template rebind_traits<Derived>;
+
+            template <typename Derived>
+            using rebind_alloc = typename traits::template rebind_alloc<Derived>;
+
+            static auto equal(Allocator const& lhs, Allocator const& rhs) noexcept -> bool
+            {
+                if constexpr (is_always_equal)
+                {
+                    return true;
+                }
+                else
+                {
+                    return lhs == rhs;
+                }
+            }
+
+            template <typename Derived, typename... Args>
+            static auto construct(Allocator& alloc, void* where, Args&&... args) -> Derived*
+            {
+                if constexpr (is_default)
+                {
+                    return new (where) Derived(std::forward<Args>(args)...);
+                }
+                else
+                {
+                    // Uses-allocator construction, if the allocator provides it
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    auto* const ptr = static_cast<Derived*>(where);
+                    rebind_traits<Derived>::construct(derived_alloc, ptr, std::forward<Args>(args)...);
+                    return ptr;
+                }
+            }
+
+            template <typename Derived, typename... Args>
+            static auto heap_new(Allocator& alloc, Args&&... args) -> Derived*
+            {
+                if constexpr (is_default)
+                {
+                    return new Derived(std::forward<Args>(args)...);
+                }
+                else
+                {
+                    static_assert(
+                        std::is_same_v<typename rebind_traits<Derived>::pointer, Derived*>,
+                        "Allocators with fancy pointers are not supported.");
+
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    auto* const ptr = rebind_traits<Derived>::allocate(derived_alloc, 1);
+                    try
+                    {
+                        rebind_traits<Derived>::construct(derived_alloc, ptr, std::forward<Args>(args)...);
+                    }
+                    catch (...)
+                    {
+                        rebind_traits<Derived>::deallocate(derived_alloc, ptr, 1);
+                        throw;
+                    }
+                    return ptr;
+                }
+            }
+
+            // Size of the heap block of a Derived. A block can be reused by
+            // another type with the same block size and alignment, as freeing it
+            // passes the same size. 0 if blocks of Derived can not be reused.
+            template <typename Derived>
+            static constexpr auto heap_block_size() noexcept -> std::size_t
+            {
+                if constexpr (is_default && has_class_allocation<Derived>::value)
+                {
+                    return 0;
+                }
+                else if constexpr (std::is_same_v<Allocator, pool_allocator<std::byte>>)
+                {
+                    return size_class_pool::block_size(sizeof(Derived), alignof(Derived));
+                }
+                else
+                {
+                    return sizeof(Derived);
+                }
+            }
+
+            // Heap block of a Derived, nullptr if out of memory. Only for types
+            // whose blocks can be reused, as delete expressions are not involved.
+            template <typename Derived>
+            static auto try_allocate(Allocator& alloc) noexcept -> void*
+            {
+                static_assert(heap_block_size<Derived>() != 0);
+                if constexpr (is_default && alignof(Derived) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                {
+                    return ::operator new(sizeof(Derived), std::align_val_t{alignof(Derived)}, std::nothrow);
+                }
+                else if constexpr (is_default)
+                {
+                    return ::operator new(sizeof(Derived), std::nothrow);
+                }
+                else
+                {
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    try
+                    {
+                        return rebind_traits<Derived>::allocate(derived_alloc, 1);
+                    }
+                    catch (std::bad_alloc const&)
+                    {
+                        return nullptr;
+                    }
+                }
+            }
+
+            // Frees a block of try_allocate that holds no object
+            template <typename Derived>
+            static void deallocate(Allocator& alloc, void* const block) noexcept
+            {
+                if constexpr (is_default && alignof(Derived) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                {
+                    ::operator delete(block, sizeof(Derived), std::align_val_t{alignof(Derived)});
+                }
+                else if constexpr (is_default)
+                {
+                    ::operator delete(block, sizeof(Derived));
+                }
+                else
+                {
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    rebind_traits<Derived>::deallocate(derived_alloc, static_cast<Derived*>(block), 1);
+                }
+            }
+
+            // Destroys the object, keeping its heap block
+            template <typename Derived>
+            static void destroy(Allocator& alloc, Derived* ptr) noexcept
+            {
+                if constexpr (is_default)
+                {
+                    ptr->~Derived();
+                }
+                else
+                {
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    rebind_traits<Derived>::destroy(derived_alloc, ptr);
+                }
+            }
+
+            template <typename Derived>
+            static void heap_delete(Allocator& alloc, Derived* ptr) noexcept
+            {
+                if constexpr (is_default && has_class_allocation<Derived>::value)
+                {
+                    delete ptr;
+                }
+                else if constexpr (is_default)
+                {
+                    // The type is known, so the destructor is not called virtually,
+                    // and the size is passed to operator delete
+                    ptr->Derived::~Derived();
+                    if constexpr (alignof(Derived) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                    {
+                        ::operator delete(ptr, sizeof(Derived), std::align_val_t{alignof(Derived)});
+                    }
+                    else
+                    {
+                        ::operator delete(ptr, sizeof(Derived));
+                    }
+                }
+                else
+                {
+                    auto derived_alloc = rebind_alloc<Derived>{alloc};
+                    rebind_traits<Derived>::destroy(derived_alloc, ptr);
+                    rebind_traits<Derived>::deallocate(derived_alloc, ptr, 1);
+                }
+            }
+        };
+
+        template <typename Allocator, bool = std::is_empty_v<Allocator> && !std::is_final_v<Allocator>>
+        class sbo_ptr_allocator_storage : private Allocator
+        {
+          public:
+            sbo_ptr_allocator_storage() noexcept(std::is_nothrow_default_constructible_v<Allocator>) = default;
+
+            constexpr explicit sbo_ptr_allocator_storage(Allocator const& alloc) noexcept
+              : Allocator{alloc}
+            {
+            }
+
+          protected:
+            [[nodiscard]] auto allocator() noexcept -> Allocator&
+            {
+                return *this;
+            }
+
+            [[nodiscard]] auto allocator() const noexcept -> Allocator const&
+            {
+                return *this;
+            }
+        };
+
+        template <typename Allocator>
+        class sbo_ptr_allocator_storage<Allocator, false>
+        {
+          public:
+            sbo_ptr_allocator_storage() noexcept(std::is_nothrow_default_constructible_v<Allocator>) = default;
+
+            constexpr explicit sbo_ptr_allocator_storage(Allocator const& alloc) noexcept
+              : allocator_{alloc}
+            {
+            }
+
+          protected:
+            [[nodiscard]] auto allocator() noexcept -> Allocator&
+            {
+                return allocator_;
+            }
+
+            [[nodiscard]] auto allocator() const noexcept -> Allocator const&
+            {
+                return allocator_;
+            }
+
+          private:
+            Allocator allocator_;
+        };
+
+        template <typename Base, bool enable_move, bool enable_copy, bool enable_heap, typename Allocator>
+        struct sbo_ptr_vtable;
+
+        // The vtable of Derived, returned by Vtable::get<Derived>(). A variable
+        // rather than a static local, so its address is a constant expression.
+        template <typename Vtable, typename Derived>
+        inline constexpr Vtable vtable_instance = Vtable::template create<Derived>();
+
+        // Objects are destroyed through the vtable, so Base needs no virtual destructor
+        template <typename Base>
+        struct sbo_ptr_vtable_destroy_base
+        {
+            // nullptr if destroying the object has no effect
+            void (*destroy)(Base*) noexcept;
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_destroy_base
+            {
+                if constexpr (std::is_trivially_destructible_v<Derived> || is_bitwise_copyable_v<Derived>)
+                {
+                    return {nullptr};
+                }
+                else
+                {
+                    return {
+                        [](Base* ptr) noexcept {
+                            to_derived<Derived>(ptr)->Derived::~Derived();
+                        },
+                    };
+                }
+            }
+        };
+
+        // Destroys an object living in a small buffer
+        template <typename Vtable, typename Base>
+        void destroy_in_place(Vtable const* const vtable, Base* const ptr) noexcept
+        {
+            if (vtable->destroy)
+            {
+                vtable->destroy(ptr);
+            }
+        }
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable_heap_base
+        {
+            void (*heap_delete)(Base*, Allocator&) noexcept;
+            // Destroys the object and returns its heap block, for reuse
+            void* (*heap_destroy)(Base*, Allocator&) noexcept;
+            std::size_t heap_block_size;
+            std::size_t heap_block_align;
+            // Charged to the heap_budget by budgeted pointers
+            std::size_t heap_object_size;
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_heap_base
+            {
+                return {
+                    [](Base* ptr, Allocator& alloc) noexcept {
+                        sbo_ptr_alloc_traits<Allocator>::heap_delete(alloc, to_derived<Derived>(ptr));
+                    },
+                    [](Base* ptr, Allocator& alloc) noexcept -> void* {
+                        auto* const object = to_derived<Derived>(ptr);
+                        sbo_ptr_alloc_traits<Allocator>::destroy(alloc, object);
+                        return object;
+                    },
+                    sbo_ptr_alloc_traits<Allocator>::template heap_block_size<Derived>(),
+                    alignof(Derived),
+                    sizeof(Derived),
+                };
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable_move_base
+        {
+            Base* (*move)(void*, void*);
+            // Moves of such objects do not need to call move
+            bool trivially_relocatable;
+            // Such objects are copied with memcpy by the range algorithms
+            bool bitwise_copyable;
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_move_base
+            {
+                static_assert(std::is_nothrow_move_constructible_v<Derived>);
+                return {
+                    [](void* from, void* to) -> Base* {
+                        auto& old_object = *reinterpret_cast<Derived*>(from);
+                        auto* const new_object = new (to) Derived(std::move(old_object));
+                        old_object.~Derived();
+                        return to_base<Base>(new_object);
+                    },
+                    is_trivially_relocatable_v<Derived> || is_bitwise_copyable_v<Derived>,
+                    is_bitwise_copyable_v<Derived>,
+                };
+            }
+        };
+
+        // Relocates an object living in a small buffer by copying the buffer bytes.
+        template <std::size_t sbo_size, typename Base>
+        auto relocate_buffer(void* from, void* to, Base* from_ptr) noexcept -> Base*
+        {
+            std::memcpy(to, from, sbo_size);
+            auto const offset = reinterpret_cast<std::byte*>(from_ptr) - static_cast<std::byte*>(from);
+            if constexpr (is_external<Base>::value)
+            {
+                return reinterpret_cast<Base*>(static_cast<std::byte*>(to) + offset);
+            }
+            else
+            {
+                return std::launder(reinterpret_cast<Base*>(static_cast<std::byte*>(to) + offset));
+            }
+        }
+
+        // Moves an object living in a small buffer; trivially relocatable
+        // objects are relocated without an indirect call.
+        template <std::size_t sbo_size, sbo_ptr_options opts, typename Base, typename Vtable>
+        auto move_buffer(Vtable const* vtable, void* from, void* to, Base* from_ptr) noexcept -> Base*
+        {
+            if constexpr ((opts & trivially_relocatable) != 0)
+            {
+                return relocate_buffer<sbo_size>(from, to, from_ptr);
+            }
+            else if (vtable->trivially_relocatable)
+            {
+                return relocate_buffer<sbo_size>(from, to, from_ptr);
+            }
+            else
+            {
+                return vtable->move(from, to);
+            }
+        }
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable_copy_base
+        {
+            Base* (*copy)(void const*, void*, Allocator&);
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_copy_base
+            {
+                return {
+                    [](void const* from, void* to, Allocator& alloc) -> Base* {
+                        auto const& old_object = *reinterpret_cast<Derived const*>(from);
+                        return to_base<Base>(sbo_ptr_alloc_traits<Allocator>::template construct<Derived>(alloc, to, old_object));
+                    },
+                };
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable_heap_move_base
+        {
+            // Only used when moving between allocators that do not compare equal
+            Base* (*heap_move)(Base*, Allocator&, Allocator&);
+            // Moves an object out of the small buffer, when it is released
+            Base* (*move_to_heap)(Base*, Allocator&);
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_heap_move_base
+            {
+                return {
+                    [](Base* from, Allocator& from_alloc, Allocator& to_alloc) -> Base* {
+                        auto* const old_object = to_derived<Derived>(from);
+                        auto* const new_object = sbo_ptr_alloc_traits<Allocator>::template heap_new<Derived>(to_alloc, std::move(*old_object));
+                        sbo_ptr_alloc_traits<Allocator>::heap_delete(from_alloc, old_object);
+                        return to_base<Base>(new_object);
+                    },
+                    [](Base* from, Allocator& alloc) -> Base* {
+                        auto* const old_object = to_derived<Derived>(from);
+                        auto* const new_object = sbo_ptr_alloc_traits<Allocator>::template heap_new<Derived>(alloc, std::move(*old_object));
+                        sbo_ptr_alloc_traits<Allocator>::destroy(alloc, old_object);
+                        return to_base<Base>(new_object);
+                    },
+                };
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable_heap_copy_base
+        {
+            Base* (*heap_copy)(Base const*, Allocator&);
+
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable_heap_copy_base
+            {
+                return {
+                    [](Base const* from, Allocator& alloc) -> Base* {
+                        return to_base<Base>(sbo_ptr_alloc_traits<Allocator>::template heap_new<Derived>(alloc, *to_derived<Derived const>(from)));
+                    },
+                };
+            }
+        };
+
+        // Pinned pointers only destroy their objects through the vtable
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, false, false, false, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, false, false, true, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>,
+            sbo_ptr_vtable_heap_base<Base, Allocator>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_base<Base, Allocator>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, true, false, false, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>,
+            sbo_ptr_vtable_move_base<Base, Allocator>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                    sbo_ptr_vtable_move_base<Base, Allocator>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, true, true, false, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>,
+            sbo_ptr_vtable_copy_base<Base, Allocator>,
+            sbo_ptr_vtable_move_base<Base, Allocator>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                    sbo_ptr_vtable_copy_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_move_base<Base, Allocator>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, true, false, true, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>,
+            sbo_ptr_vtable_move_base<Base, Allocator>,
+            sbo_ptr_vtable_heap_base<Base, Allocator>,
+            sbo_ptr_vtable_heap_move_base<Base, Allocator>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                    sbo_ptr_vtable_move_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_move_base<Base, Allocator>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_vtable<Base, true, true, true, Allocator>
+          : sbo_ptr_vtable_destroy_base<Base>,
+            operations_t<Base>,
+            sbo_ptr_vtable_copy_base<Base, Allocator>,
+            sbo_ptr_vtable_move_base<Base, Allocator>,
+            sbo_ptr_vtable_heap_base<Base, Allocator>,
+            sbo_ptr_vtable_heap_move_base<Base, Allocator>,
+            sbo_ptr_vtable_heap_copy_base<Base, Allocator>
+        {
+            template <typename Derived>
+            static constexpr auto create() noexcept -> sbo_ptr_vtable
+            {
+                return {
+                    sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                    operations_t<Base>::template create<Derived>(),
+                    sbo_ptr_vtable_copy_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_move_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_move_base<Base, Allocator>::template create<Derived>(),
+                    sbo_ptr_vtable_heap_copy_base<Base, Allocator>::template create<Derived>(),
+                };
+            }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_vtable, Derived>;
+            }
+        };
+
+        // Heap objects of copy-on-write pointers follow their reference count.
+        // The object is constructed separately, so the allocator can still
+        // apply uses-allocator construction to it.
+        template <typename Derived>
+        struct cow_block
+        {
+            std::atomic<std::size_t> refs{1};
+            alignas(Derived) std::byte object[sizeof(Derived)];
+
+            [[nodiscard]] static auto of(Derived const* const object) noexcept -> cow_block*
+            {
+                static_assert(std::is_standard_layout_v<cow_block>);
+                auto* const bytes = reinterpret_cast<std::byte*>(const_cast<Derived*>(object)) - offsetof(cow_block, object);
+                return std::launder(reinterpret_cast<cow_block*>(bytes));
+            }
+        };
 
-    namespace detail
-    {
-        template <typename Base, bool enable_move, bool enable_copy, bool enable_heap>
-        struct sbo_ptr_vtable;
+        // Block for a cow object, nullptr if out of memory
+        template <typename Derived, typename Allocator>
+        auto cow_try_allocate(Allocator& alloc) noexcept -> cow_block<Derived>*
+        {
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using block_traits = typename alloc_traits::template rebind_traits<cow_block<Derived>>;
 
-        struct sbo_ptr_vtable_heap_base
+            auto block_alloc = typename alloc_traits::template rebind_alloc<cow_block<Derived>>{alloc};
+            try
+            {
+                return new (block_traits::allocate(block_alloc, 1)) cow_block<Derived>;
+            }
+            catch (std::bad_alloc const&)
+            {
+                return nullptr;
+            }
+        }
+
+        // Constructs the object in a new block, which is freed if that throws
+        template <typename Derived, typename Allocator, typename... Args>
+        auto cow_construct(Allocator& alloc, cow_block<Derived>* const block, Args&&... args) -> Derived*
         {
-            bool on_heap;
-        };
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using block_traits = typename alloc_traits::template rebind_traits<cow_block<Derived>>;
 
-        template <typename Base>
-        struct sbo_ptr_vtable_move_base
+            try
+            {
+                return alloc_traits::template construct<Derived>(alloc, block->object, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                auto block_alloc = typename alloc_traits::template rebind_alloc<cow_block<Derived>>{alloc};
+                block_traits::deallocate(block_alloc, block, 1);
+                throw;
+            }
+        }
+
+        template <typename Derived, typename Allocator, typename... Args>
+        auto cow_heap_new(Allocator& alloc, Args&&... args) -> Derived*
         {
-            Base* (*move)(void*, void*);
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using block_traits = typename alloc_traits::template rebind_traits<cow_block<Derived>>;
 
-            template <typename Derived>
-            static constexpr auto create() noexcept -> sbo_ptr_vtable_move_base
+            auto block_alloc = typename alloc_traits::template rebind_alloc<cow_block<Derived>>{alloc};
+            auto* const block = new (block_traits::allocate(block_alloc, 1)) cow_block<Derived>;
+            return cow_construct<Derived>(alloc, block, std::forward<Args>(args)...);
+        }
+
+        // Drops a reference, the last one frees the object
+        template <typename Derived, typename Allocator>
+        void cow_release(Allocator& alloc, Derived* const object) noexcept
+        {
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using block_traits = typename alloc_traits::template rebind_traits<cow_block<Derived>>;
+
+            auto* const block = cow_block<Derived>::of(object);
+            if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
             {
-                static_assert(std::is_nothrow_move_constructible_v<Derived>);
-                return {
-                    [](void* from, void* to) -> Base* {
-                        auto& old_object = *reinterpret_cast<Derived*>(from);
-                        auto* const new_ptr = new (to) Derived(std::move(old_object));
-                        old_object.~Derived();
-                        return new_ptr;
-                    },
-                };
+                auto derived_alloc = typename alloc_traits::template rebind_alloc<Derived>{alloc};
+                alloc_traits::template rebind_traits<Derived>::destroy(derived_alloc, object);
+                auto block_alloc = typename alloc_traits::template rebind_alloc<cow_block<Derived>>{alloc};
+                block_traits::deallocate(block_alloc, block, 1);
             }
-        };
+        }
 
-        template <typename Base>
-        struct sbo_ptr_vtable_copy_base
+        // Vtable of pointers with the cow option: the heap entries work on
+        // reference counted blocks, and heap_copy makes an unshared copy.
+        template <typename Base, typename Allocator>
+        struct sbo_ptr_cow_vtable : sbo_ptr_vtable<Base, true, true, true, Allocator>
         {
-            Base* (*copy)(void const*, void*);
+            std::atomic<std::size_t>& (*cow_refs)(Base const*) noexcept;
 
             template <typename Derived>
-            static constexpr auto create() noexcept -> sbo_ptr_vtable_copy_base
+            static constexpr auto create() noexcept -> sbo_ptr_cow_vtable
             {
                 return {
-                    [](void const* from, void* to) -> Base* {
-                        auto const& old_object = *reinterpret_cast<Derived const*>(from);
-                        return new (to) Derived(old_object);
+                    {
+                        sbo_ptr_vtable_destroy_base<Base>::template create<Derived>(),
+                        operations_t<Base>::template create<Derived>(),
+                        sbo_ptr_vtable_copy_base<Base, Allocator>::template create<Derived>(),
+                        sbo_ptr_vtable_move_base<Base, Allocator>::template create<Derived>(),
+                        {
+                            [](Base* ptr, Allocator& alloc) noexcept {
+                                cow_release(alloc, to_derived<Derived>(ptr));
+                            },
+                            // Blocks may be shared, so they are never reused
+                            nullptr,
+                            0,
+                            alignof(Derived),
+                            sizeof(Derived),
+                        },
+                        {
+                            [](Base* from, Allocator& from_alloc, Allocator& to_alloc) -> Base* {
+                                auto* const old_object = to_derived<Derived>(from);
+                                // Other owners may still read a shared object
+                                auto* const new_object = cow_block<Derived>::of(old_object)->refs.load(std::memory_order_acquire) == 1
+                                                          ? cow_heap_new<Derived>(to_alloc, std::move(*old_object))
+                                                          : cow_heap_new<Derived>(to_alloc, std::as_const(*old_object));
+                                cow_release(from_alloc, old_object);
+                                return to_base<Base>(new_object);
+                            },
+                            // Objects of cow pointers can not be released
+                            nullptr,
+                        },
+                        {
+                            [](Base const* from, Allocator& alloc) -> Base* {
+                                return to_base<Base>(cow_heap_new<Derived>(alloc, *to_derived<Derived const>(from)));
+                            },
+                        },
+                    },
+                    [](Base const* ptr) noexcept -> std::atomic<std::size_t>& {
+                        return cow_block<Derived>::of(to_derived<Derived const>(ptr))->refs;
                     },
                 };
             }
+
+            template <typename Derived>
+            static constexpr auto get() noexcept -> sbo_ptr_cow_vtable const*
+            {
+                return &vtable_instance<sbo_ptr_cow_vtable, Derived>;
+            }
         };
 
-        template <typename Base>
-        struct sbo_ptr_vtable_heap_copy_base
+        // Vtable extended with the statistics record of Derived. Only used by
+        // instrumented pointers with heap fallback, so other pointers do not
+        // pay for the entry (or instantiate the records).
+        template <typename Vtable>
+        struct sbo_ptr_instrumented_vtable : Vtable
         {
-            Base* (*heap_copy)(Base const*);
+            heap_fallback_record* heap_stats;
 
             template <typename Derived>
-            static constexpr auto create() noexcept -> sbo_ptr_vtable_heap_copy_base
+            static constexpr auto create() noexcept -> sbo_ptr_instrumented_vtable
             {
                 return {
-                    [](Base const* from) -> Base* {
-                        return new Derived{*static_cast<Derived const*>(from)};
-                    },
+                    Vtable::template create<Derived>(),
+                    &heap_fallback_record_for<Derived>,
                 };
             }
-        };
 
-        template <typename Base>
-        struct sbo_ptr_vtable<Base, true, false, false>
-          : sbo_ptr_vtable_move_base<Base>
-        {
             template <typename Derived>
-            static auto get() noexcept -> sbo_ptr_vtable const*
+            static constexpr auto get() noexcept -> sbo_ptr_instrumented_vtable const*
             {
-                static constexpr auto vtable = sbo_ptr_vtable{
-                    sbo_ptr_vtable_move_base<Base>::template create<Derived>(),
-                };
-                return &vtable;
+                return &vtable_instance<sbo_ptr_instrumented_vtable, Derived>;
             }
         };
 
+        // Buffer alignment of the compact layout
         template <typename Base>
-        struct sbo_ptr_vtable<Base, true, true, false>
-          : sbo_ptr_vtable_copy_base<Base>,
-            sbo_ptr_vtable_move_base<Base>
+        inline constexpr auto compact_alignment = std::max(alignof(Base), alignof(Base*));
+
+        // Buffer alignment, unless given explicitly
+        template <typename Base, std::size_t sbo_size, sbo_ptr_options opts>
+        inline constexpr auto default_sbo_alignment = (opts & compact) != 0 ? compact_alignment<Base> : alignof(std::aligned_storage_t<sbo_size>);
+
+        // Objects that do not fit the buffer, by size or by alignment, go to the heap
+        template <typename Derived, std::size_t sbo_size, std::size_t sbo_align>
+        inline constexpr bool fits_buffer = sizeof(Derived) <= sbo_size && alignof(Derived) <= sbo_align;
+
+        // Heap objects that can take over the block of the heap object they replace
+        template <typename Derived, std::size_t sbo_size, std::size_t sbo_align, typename Allocator, typename... Args>
+        inline constexpr bool reuses_heap_block = !fits_buffer<Derived, sbo_size, sbo_align>
+                                                  && sbo_ptr_alloc_traits<Allocator>::template heap_block_size<Derived>() != 0
+                                                  && std::is_nothrow_constructible_v<Derived, Args...>;
+
+        // Whether pointers with the given options can hold a Derived constructed from Args.
+        // Each condition is only checked if the previous ones hold.
+        template <typename Base, sbo_ptr_options opts, typename Derived, typename... Args>
+        constexpr auto can_emplace() noexcept -> bool
         {
-            template <typename Derived>
-            static auto get() noexcept -> sbo_ptr_vtable const*
+            if constexpr (!is_storable<Base, Derived>)
             {
-                static constexpr auto vtable = sbo_ptr_vtable{
-                    sbo_ptr_vtable_copy_base<Base>::template create<Derived>(),
-                    sbo_ptr_vtable_move_base<Base>::template create<Derived>(),
-                };
-                return &vtable;
+                return false;
             }
-        };
+            else if constexpr (!std::is_constructible_v<Derived, Args&&...>)
+            {
+                return false;
+            }
+            else if constexpr ((opts & movable) != 0 && !std::is_nothrow_move_constructible_v<Derived>)
+            {
+                return false;
+            }
+            else if constexpr ((opts & copyable) != 0 && !std::is_copy_constructible_v<Derived>)
+            {
+                return false;
+            }
+            else
+            {
+                return (opts & trivially_relocatable) == 0 || is_trivially_relocatable_v<Derived> || is_bitwise_copyable_v<Derived>;
+            }
+        }
 
-        template <typename Base>
-        struct sbo_ptr_vtable<Base, true, false, true>
-          : sbo_ptr_vtable_move_base<Base>,
-            sbo_ptr_vtable_heap_base
+        template <std::size_t sbo_size, std::size_t sbo_align, sbo_ptr_options opts, typename Derived, typename... Args>
+        constexpr auto can_nothrow_emplace() noexcept -> bool
+        {
+            return std::is_nothrow_constructible_v<Derived, Args&&...> && ((opts & allow_heap) == 0 || fits_buffer<Derived, sbo_size, sbo_align>);
+        }
+
+        // The offset of Base within Derived. Not a constant expression, as no Derived
+        // exists, but compilers fold it to a constant.
+        template <typename Base, typename Derived>
+        [[nodiscard]] auto base_offset_of() noexcept -> std::ptrdiff_t
+        {
+            alignas(Derived) static std::byte probe[sizeof(Derived)];
+            auto* const derived = reinterpret_cast<Derived*>(probe);
+            return reinterpret_cast<std::byte*>(to_base<Base>(derived)) - probe;
+        }
+
+        // The compact vtable of Derived, returned by Vtable::get<Base, Derived>().
+        // A variable rather than a static local, so taking its address needs no guard.
+        // It is initialized before main; the offset is folded into a constant.
+        template <typename Vtable, typename Base, typename Derived>
+        inline Vtable const compact_vtable_instance = Vtable::template create<Base, Derived>();
+
+        // Vtable extended with the offset of Base within Derived,
+        // used by the compact layout to find objects stored in place.
+        template <typename Vtable>
+        struct sbo_ptr_compact_vtable : Vtable
         {
-            template <typename Derived, bool on_heap>
-            static auto get() noexcept -> sbo_ptr_vtable const*
+            std::ptrdiff_t base_offset;
+            // The regular vtable of Derived, identifies the type
+            Vtable const* identity;
+
+            template <typename Base, typename Derived>
+            static auto create() noexcept -> sbo_ptr_compact_vtable
             {
-                static constexpr auto vtable = sbo_ptr_vtable{
-                    sbo_ptr_vtable_move_base<Base>::template create<Derived>(),
-                    {on_heap},
+                return {
+                    *Vtable::template get<Derived>(),
+                    base_offset_of<Base, Derived>(),
+                    Vtable::template get<Derived>(),
                 };
-                return &vtable;
             }
-        };
 
-        template <typename Base>
-        struct sbo_ptr_vtable<Base, true, true, true>
-          : sbo_ptr_vtable_copy_base<Base>,
-            sbo_ptr_vtable_move_base<Base>,
-            sbo_ptr_vtable_heap_base,
-            sbo_ptr_vtable_heap_copy_base<Base>
-        {
-            template <typename Derived, bool on_heap>
-            static auto get() noexcept -> sbo_ptr_vtable const*
-            {
-                static constexpr auto vtable = sbo_ptr_vtable{
-                    sbo_ptr_vtable_copy_base<Base>::template create<Derived>(),
-                    sbo_ptr_vtable_move_base<Base>::template create<Derived>(),
-                    {on_heap},
-                    sbo_ptr_vtable_heap_copy_base<Base>::template create<Derived>(),
-                };
-                return &vtable;
+            template <typename Base, typename Derived>
+            static auto get() noexcept -> sbo_ptr_compact_vtable const*
+            {
+                return &compact_vtable_instance<sbo_ptr_compact_vtable, Base, Derived>;
             }
         };
 
-        template <typename Base, std::size_t sbo_size, bool enable_move, bool enable_copy, bool enable_heap, typename Derived, typename... Args>
-        struct can_emplace;
+        // The lowest bit of a stored vtable or object pointer marks heap objects,
+        // so destroy and move can branch on a value that is already loaded.
+        inline constexpr auto heap_bit = std::uintptr_t{1};
 
-        template <typename Base, std::size_t sbo_size, bool enable_heap, typename Derived, typename... Args>
-        struct can_emplace<Base, sbo_size, false, false, enable_heap, Derived, Args...>
-          : std::conjunction<
-                std::is_convertible<Derived*, Base*>,
-                std::is_constructible<Derived, Args&&...>>
+        template <typename Vtable>
+        [[nodiscard]] auto tag_vtable(Vtable const* const vtable, bool const is_on_heap) noexcept -> std::uintptr_t
         {
-        };
+            static_assert(alignof(Vtable) > heap_bit);
+            return reinterpret_cast<std::uintptr_t>(vtable) | (is_on_heap ? heap_bit : 0);
+        }
 
-        template <typename Base, std::size_t sbo_size, bool enable_heap, typename Derived, typename... Args>
-        struct can_emplace<Base, sbo_size, true, false, enable_heap, Derived, Args...>
-          : std::conjunction<
-                std::is_convertible<Derived*, Base*>,
-                std::is_constructible<Derived, Args&&...>,
-                std::is_nothrow_move_constructible<Derived>>
+        // Types with a member in the small buffer, listed by the _for aliases
+        template <typename... Ds>
+        struct buffer_members
         {
         };
 
-        template <typename Base, std::size_t sbo_size, bool enable_heap, typename Derived, typename... Args>
-        struct can_emplace<Base, sbo_size, true, true, enable_heap, Derived, Args...>
-          : std::conjunction<
-                std::is_convertible<Derived*, Base*>,
-                std::is_constructible<Derived, Args&&...>,
-                std::is_nothrow_move_constructible<Derived>,
-                std::is_copy_constructible<Derived>>
+        template <typename Derived, typename Members>
+        struct is_buffer_member : std::false_type
         {
         };
 
-        template <typename Base, std::size_t sbo_size, sbo_ptr_options opts, typename Derived, typename... Args>
-        struct can_emplace_opts : can_emplace<Base, sbo_size, opts & movable, opts & copyable, opts & allow_heap, Derived, Args...>
+        template <typename Derived, typename... Ds>
+        struct is_buffer_member<Derived, buffer_members<Ds...>> : std::bool_constant<(std::is_same_v<Derived, Ds> || ...)>
         {
         };
 
-        template <typename Base, std::size_t sbo_size, bool enable_move, bool enable_copy, bool enable_heap, typename Derived, typename... Args>
-        struct can_nothrow_emplace;
-
-        template <typename Base, std::size_t sbo_size, bool enable_move, bool enable_copy, typename Derived, typename... Args>
-        struct can_nothrow_emplace<Base, sbo_size, enable_move, enable_copy, false, Derived, Args...>
-          : std::is_nothrow_constructible<Derived, Args&&...>
+        // Storage of the small buffer. Only the first byte is initialized,
+        // so that empty pointers are constant-initialized (and can be constinit)
+        // without clearing the whole buffer.
+        template <std::size_t size, std::size_t align, typename Members = buffer_members<>>
+        union sbo_buffer
         {
+            std::byte first = {};
+            alignas(align) std::byte bytes[size];
         };
 
-        template <typename Base, std::size_t sbo_size, bool enable_move, bool enable_copy, typename Derived, typename... Args>
-        struct can_nothrow_emplace<Base, sbo_size, enable_move, enable_copy, true, Derived, Args...>
-          : std::conjunction<
-                std::is_nothrow_constructible<Derived, Args&&...>,
-                std::bool_constant<(sizeof(Derived) <= sbo_size)>>
+#ifdef SBOPTR_HAS_CONSTEXPR_CONSTRUCTION
+        // A buffer with a member for each of the listed types. Objects of these
+        // are constructed in their member, so that constant evaluation sees
+        // a typed object rather than one placed in bytes.
+        template <std::size_t size, std::size_t align, typename D, typename... Ds>
+        union sbo_buffer<size, align, buffer_members<D, Ds...>>
         {
-        };
+            sbo_buffer<size, align, buffer_members<Ds...>> rest = {};
+            D object;
 
-        template <typename Base, std::size_t sbo_size, sbo_ptr_options opts, typename Derived, typename... Args>
-        struct can_nothrow_emplace_opts : can_nothrow_emplace<Base, sbo_size, opts & movable, opts & copyable, opts & allow_heap, Derived, Args...>
-        {
-        };
+            constexpr sbo_buffer() noexcept { }
+
+            // The object is destroyed by the pointer, through the vtable
+            constexpr ~sbo_buffer() noexcept { }
 
-        template <typename Base, std::size_t sbo_size, bool enable_move, bool enable_copy, bool enable_heap>
-        class sbo_ptr_base;
+            template <typename Derived, typename... Args>
+            constexpr auto construct(Args&&... args) -> Derived*
+            {
+                if constexpr (std::is_same_v<Derived, D>)
+                {
+                    return std::construct_at(&object, std::forward<Args>(args)...);
+                }
+                else
+                {
+                    std::construct_at(&rest);
+                    return rest.template construct<Derived>(std::forward<Args>(args)...);
+                }
+            }
+        };
+#endif
 
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, false, false, false>
+        // Object pointer, vtable and small buffer of the regular layout.
+        template <typename Base, std::size_t sbo_size, std::size_t sbo_align, typename Vtable, bool enable_heap, bool compact, typename Members = buffer_members<>>
+        class sbo_ptr_storage
         {
           public:
-            sbo_ptr_base() noexcept = default;
+            using vtable_type = Vtable;
+
+            // ptr_ points into sbo_buffer_ for objects stored in place
+            static constexpr bool self_referential = true;
 
-            sbo_ptr_base(sbo_ptr_base const&) = delete;
-            sbo_ptr_base(sbo_ptr_base&&) = delete;
-            sbo_ptr_base& operator=(sbo_ptr_base const&) = delete;
-            sbo_ptr_base& operator=(sbo_ptr_base&&) = delete;
+            template <typename Derived>
+            static constexpr bool has_member = is_buffer_member<Derived, Members>::value;
 
-            ~sbo_ptr_base() noexcept
+            template <typename Derived>
+            [[nodiscard]] static constexpr auto vtable_for(Derived*) noexcept -> vtable_type const*
             {
-                destroy();
+                return Vtable::template get<Derived>();
             }
 
-          protected:
-            Base* ptr_ = nullptr;
-
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, false, false, false, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, false, false, false, Derived, Args&&...>::value)
+            [[nodiscard]] constexpr auto empty() const noexcept -> bool
             {
-                static_assert(
-                    sizeof(Derived) <= sbo_size,
-                    "Derived class is too big to store. Increase the small buffer size or allow heap allocations.");
-                ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
+                return vtable_ == nullptr;
             }
 
-            void destroy() noexcept
+            [[nodiscard]] auto on_heap() const noexcept -> bool
             {
-                if (ptr_)
-                {
-                    std::exchange(ptr_, nullptr)->~Base();
-                }
+                return enable_heap && (reinterpret_cast<std::uintptr_t>(vtable_) & heap_bit) != 0;
             }
 
-          private:
-            std::aligned_storage_t<sbo_size> sbo_buffer_;
-        };
-
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, true, false, false>
-        {
-          public:
-            sbo_ptr_base() noexcept = default;
-
-            sbo_ptr_base(sbo_ptr_base const&) = delete;
-
-            sbo_ptr_base(sbo_ptr_base&& other) noexcept
+            [[nodiscard]] constexpr auto ptr() const noexcept -> Base*
             {
-                construct_from(std::move(other));
+                return ptr_;
             }
 
-            auto operator=(sbo_ptr_base const&) = delete;
+            [[nodiscard]] auto vtable() const noexcept -> vtable_type const*
+            {
+                return reinterpret_cast<vtable_type const*>(reinterpret_cast<std::uintptr_t>(vtable_) & ~heap_bit);
+            }
 
-            auto operator=(sbo_ptr_base&& other) noexcept -> sbo_ptr_base&
+            // Every Derived has a single vtable, so the type is known from its address
+            template <typename Derived>
+            [[nodiscard]] auto holds() const noexcept -> bool
             {
-                if (this != &other)
-                {
-                    destroy();
-                    construct_from(std::move(other));
-                }
-                return *this;
+                return vtable() == Vtable::template get<Derived>();
             }
 
-            ~sbo_ptr_base() noexcept
+            [[nodiscard]] auto buffer() noexcept -> void*
             {
-                destroy();
+                return &sbo_buffer_;
             }
 
-          protected:
-            Base* ptr_ = nullptr;
-            sbo_ptr_vtable<Base, true, false, false> const* vtable_ = nullptr;
+            [[nodiscard]] auto buffer() const noexcept -> void const*
+            {
+                return &sbo_buffer_;
+            }
 
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, true, false, false, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, true, false, false, Derived, Args&&...>::value)
+            // Constructs one of the listed types in its member of the buffer
+            template <typename Derived, typename... Args>
+            constexpr auto construct_member(Args&&... args) -> Derived*
             {
-                static_assert(
-                    sizeof(Derived) <= sbo_size,
-                    "Derived class is too big to store. Increase the small buffer size or allow heap allocations.");
-                ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
-                vtable_ = sbo_ptr_vtable<Base, true, false, false>::template get<Derived>();
+                return sbo_buffer_.template construct<Derived>(std::forward<Args>(args)...);
             }
 
-            void construct_from(sbo_ptr_base&& other) noexcept
+            constexpr void set(Base* const ptr, vtable_type const* const vtable, bool const is_on_heap = false) noexcept
             {
-                if (std::exchange(other.ptr_, nullptr))
-                {
-                    ptr_ = other.vtable_->move(&other.sbo_buffer_, &sbo_buffer_);
-                    vtable_ = std::exchange(other.vtable_, nullptr);
-                }
+                ptr_ = ptr;
+                // Only heap objects need the cast, which constant expressions do not allow
+                vtable_ = is_on_heap ? reinterpret_cast<void const*>(tag_vtable(vtable, true)) : vtable;
             }
 
-            void destroy() noexcept
+            void clear() noexcept
             {
-                if (ptr_)
-                {
-                    std::exchange(ptr_, nullptr)->~Base();
-                }
+                ptr_ = nullptr;
+                vtable_ = nullptr;
             }
 
           private:
-            std::aligned_storage_t<sbo_size> sbo_buffer_;
+            Base* ptr_ = nullptr;
+            // Tagged with heap_bit for heap objects. Kept as a pointer,
+            // so that it can be set in constant expressions.
+            void const* vtable_ = nullptr;
+            sbo_buffer<sbo_size, sbo_align, Members> sbo_buffer_;
         };
 
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, true, true, false>
+        // Compact layout: no object pointer is stored. Objects in place are found
+        // through the Base offset kept in the vtable; for heap objects,
+        // the small buffer holds the pointer.
+        // The buffer is only pointer-aligned by default (instead of max_align_t-aligned),
+        // otherwise the padding would eat up the saved space.
+        template <typename Base, std::size_t sbo_size, std::size_t sbo_align, typename Vtable, bool enable_heap, typename Members>
+        class sbo_ptr_storage<Base, sbo_size, sbo_align, Vtable, enable_heap, true, Members>
         {
           public:
-            sbo_ptr_base() noexcept = default;
+            using vtable_type = sbo_ptr_compact_vtable<Vtable>;
 
-            sbo_ptr_base(sbo_ptr_base const& other)
+            static constexpr bool self_referential = false;
+
+            // The vtable is only known at run time, so objects are always placed in bytes
+            template <typename Derived>
+            static constexpr bool has_member = false;
+
+            template <typename Derived>
+            [[nodiscard]] static auto vtable_for([[maybe_unused]] Derived* const object) noexcept -> vtable_type const*
             {
-                construct_from(other);
+                auto* const vtable = vtable_type::template get<Base, Derived>();
+                // Fails if the vtable is used before it is initialized, during static initialization
+                SBOPTR_ASSERT(vtable->base_offset == reinterpret_cast<std::byte*>(to_base<Base>(object)) - reinterpret_cast<std::byte*>(object));
+                return vtable;
             }
 
-            sbo_ptr_base(sbo_ptr_base&& other) noexcept
+            [[nodiscard]] auto empty() const noexcept -> bool
             {
-                construct_from(std::move(other));
+                return vtable_ == 0;
             }
 
-            auto operator=(sbo_ptr_base const& other) -> sbo_ptr_base&
+            [[nodiscard]] auto on_heap() const noexcept -> bool
             {
-                if (this != &other)
-                {
-                    // Strong exception guarantee
-                    auto copy = other;
-                    destroy();
-                    construct_from(std::move(copy));
-                }
-                return *this;
+                return enable_heap && (vtable_ & heap_bit) != 0;
             }
 
-            auto operator=(sbo_ptr_base&& other) noexcept -> sbo_ptr_base&
+            [[nodiscard]] auto ptr() const noexcept -> Base*
             {
-                if (this != &other)
+                if (empty())
                 {
-                    destroy();
-                    construct_from(std::move(other));
+                    return nullptr;
+                }
+                auto* const buffer = const_cast<std::byte*>(sbo_buffer_.bytes);
+                if (on_heap())
+                {
+                    return *std::launder(reinterpret_cast<Base**>(buffer));
+                }
+                if constexpr (is_external<Base>::value)
+                {
+                    return reinterpret_cast<Base*>(buffer + vtable()->base_offset);
+                }
+                else
+                {
+                    return std::launder(reinterpret_cast<Base*>(buffer + vtable()->base_offset));
                 }
-                return *this;
             }
 
-            ~sbo_ptr_base() noexcept
+            [[nodiscard]] auto vtable() const noexcept -> vtable_type const*
             {
-                destroy();
+                return reinterpret_cast<vtable_type const*>(vtable_ & ~heap_bit);
             }
 
-          protected:
-            Base* ptr_ = nullptr;
-            sbo_ptr_vtable<Base, true, true, false> const* vtable_ = nullptr;
+            template <typename Derived>
+            [[nodiscard]] auto holds() const noexcept -> bool
+            {
+                return !empty() && vtable()->identity == Vtable::template get<Derived>();
+            }
 
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, false, false, false, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, false, false, false, Derived, Args&&...>::value)
+            [[nodiscard]] auto buffer() noexcept -> void*
             {
-                static_assert(
-                    sizeof(Derived) <= sbo_size,
-                    "Derived class is too big to store. Increase the small buffer size or allow heap allocations.");
-                ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
-                vtable_ = sbo_ptr_vtable<Base, true, true, false>::template get<Derived>();
+                return sbo_buffer_.bytes;
             }
 
-            void construct_from(sbo_ptr_base&& other) noexcept
+            [[nodiscard]] auto buffer() const noexcept -> void const*
             {
-                if (std::exchange(other.ptr_, nullptr))
-                {
-                    ptr_ = other.vtable_->move(&other.sbo_buffer_, &sbo_buffer_);
-                    vtable_ = std::exchange(other.vtable_, nullptr);
-                }
+                return sbo_buffer_.bytes;
             }
 
-            void construct_from(sbo_ptr_base const& other)
+            void set(Base* const ptr, vtable_type const* const vtable, bool const is_on_heap = false) noexcept
             {
-                if (other.ptr_)
+                if constexpr (enable_heap)
                 {
-                    ptr_ = other.vtable_->copy(&other.sbo_buffer_, &sbo_buffer_);
-                    vtable_ = other.vtable_;
+                    if (is_on_heap)
+                    {
+                        new (sbo_buffer_.bytes) Base*(ptr);
+                    }
                 }
+                vtable_ = tag_vtable(vtable, is_on_heap);
             }
 
-            void destroy() noexcept
+            void clear() noexcept
             {
-                if (ptr_)
-                {
-                    std::exchange(ptr_, nullptr)->~Base();
-                }
+                vtable_ = 0;
             }
 
           private:
-            std::aligned_storage_t<sbo_size> sbo_buffer_;
+            // Heap objects need room for their pointer
+            static constexpr auto buffer_size = enable_heap ? std::max(sbo_size, sizeof(Base*)) : sbo_size;
+
+            // The vtable is placed last, and the buffer is aligned as a member rather than
+            // through sbo_buffer, so if sbo_size is not a multiple of the buffer alignment,
+            // the vtable can share the padding.
+            alignas(std::max(sbo_align, compact_alignment<Base>)) sbo_buffer<buffer_size, 1> sbo_buffer_;
+            // Tagged with heap_bit for heap objects
+            std::uintptr_t vtable_ = 0;
         };
 
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, false, false, true>
+        template <typename Base, sbo_ptr_options opts, typename Allocator>
+        using sbo_ptr_uninstrumented_vtable_for_opts = std::conditional_t<
+            (opts & cow) != 0 && (opts & copyable) != 0 && (opts & allow_heap) != 0,
+            sbo_ptr_cow_vtable<Base, Allocator>,
+            sbo_ptr_vtable<Base, (opts & movable) != 0, (opts & copyable) != 0, (opts & allow_heap) != 0, Allocator>>;
+
+        template <typename Base, sbo_ptr_options opts, typename Allocator>
+        using sbo_ptr_vtable_for_opts = std::conditional_t<
+            is_instrumented<opts> && (opts & allow_heap) != 0,
+            sbo_ptr_instrumented_vtable<sbo_ptr_uninstrumented_vtable_for_opts<Base, opts, Allocator>>,
+            sbo_ptr_uninstrumented_vtable_for_opts<Base, opts, Allocator>>;
+
+        template <typename Base, std::size_t sbo_size, std::size_t sbo_align, sbo_ptr_options opts, typename Allocator, typename Members>
+        using sbo_ptr_storage_for_opts = sbo_ptr_storage<
+            Base,
+            sbo_size,
+            sbo_align,
+            sbo_ptr_vtable_for_opts<Base, opts, Allocator>,
+            (opts & allow_heap) != 0,
+            (opts & compact) != 0,
+            Members>;
+
+        template <sbo_ptr_options opts, typename Derived>
+        constexpr void count_construction(bool const on_heap) noexcept
+        {
+            if constexpr (is_instrumented<opts> && (opts & allow_heap) != 0)
+            {
+                heap_fallback_record_for<Derived>.count_construction(on_heap);
+            }
+        }
+
+        // The heap_budget charged for the heap object, kept by budgeted pointers.
+        // nullptr for adopted objects, which were not charged.
+        template <bool enable_budget>
+        class sbo_ptr_budget_storage
         {
           public:
-            sbo_ptr_base() noexcept = default;
+            [[nodiscard]] constexpr auto budget() const noexcept -> heap_budget*
+            {
+                return nullptr;
+            }
 
-            sbo_ptr_base(sbo_ptr_base const&) = delete;
-            sbo_ptr_base(sbo_ptr_base&&) noexcept = delete;
-            sbo_ptr_base& operator=(sbo_ptr_base const&) = delete;
-            sbo_ptr_base& operator=(sbo_ptr_base&&) noexcept = delete;
+            void set_budget(heap_budget*) noexcept { }
+        };
 
-            ~sbo_ptr_base() noexcept
+        template <>
+        class sbo_ptr_budget_storage<true>
+        {
+          public:
+            [[nodiscard]] auto budget() const noexcept -> heap_budget*
             {
-                destroy();
+                return budget_;
             }
 
-          protected:
-            Base* ptr_ = nullptr;
+            void set_budget(heap_budget* const budget) noexcept
+            {
+                budget_ = budget;
+            }
 
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, false, false, true, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, false, false, true, Derived, Args&&...>::value)
+          private:
+            heap_budget* budget_ = nullptr;
+        };
+
+        // Bytes charged to the budget of this thread for a heap object.
+        // Given back, unless committed once the object is constructed.
+        template <bool enable_budget>
+        class heap_budget_charge
+        {
+          public:
+            explicit heap_budget_charge(std::size_t) noexcept { }
+
+            // Whether the budget allowed the charge
+            [[nodiscard]] explicit operator bool() const noexcept
             {
-                if constexpr (sizeof(Derived) <= sbo_size)
-                {
-                    ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
-                    on_heap_ = false;
-                }
-                else
+                return true;
+            }
+
+            [[nodiscard]] auto commit() noexcept -> heap_budget*
+            {
+                return nullptr;
+            }
+        };
+
+        template <>
+        class heap_budget_charge<true>
+        {
+          public:
+            explicit heap_budget_charge(std::size_t const bytes) noexcept
+              : budget_{&heap_budget::current()},
+                bytes_{bytes}
+            {
+                if (!budget_->try_acquire(bytes))
                 {
-                    ptr_ = new Derived(std::forward<Args>(args)...);
-                    on_heap_ = true;
+                    budget_ = nullptr;
                 }
             }
 
-            void destroy() noexcept
+            heap_budget_charge(heap_budget_charge const&) = delete;
+            auto operator=(heap_budget_charge const&) -> heap_budget_charge& = delete;
+
+            ~heap_budget_charge() noexcept
             {
-                if (ptr_)
+                if (budget_)
                 {
-                    if (on_heap_)
-                    {
-                        delete std::exchange(ptr_, nullptr);
-                    }
-                    else
-                    {
-                        std::exchange(ptr_, nullptr)->~Base();
-                    }
+                    budget_->release(bytes_);
                 }
             }
 
+            [[nodiscard]] explicit operator bool() const noexcept
+            {
+                return budget_ != nullptr;
+            }
+
+            [[nodiscard]] auto commit() noexcept -> heap_budget*
+            {
+                return std::exchange(budget_, nullptr);
+            }
+
           private:
-            // We do not require a vtable for this case.
-            // The on_heap flag is intentionaly placed last,
-            // so if sbo_size is not a multiple of alignment,
-            // the flag gets placed in the padding.
-            // To allow that, we must not use aligned_storage_t struct
-            // directly (otherwise the padding would be forced);
-            // we just use it to figure out proper alignment.
-            alignas(alignof(std::aligned_storage_t<sbo_size>)) std::byte sbo_buffer_[sbo_size];
-            bool on_heap_ = false;
+            heap_budget* budget_;
+            std::size_t bytes_;
+        };
+
+        // Deletes the special members of basic_sbo_ptr that its options do not provide
+        template <bool enable_move, bool enable_copy>
+        struct sbo_ptr_special_members
+        {
+        };
+
+        template <>
+        struct sbo_ptr_special_members<true, false>
+        {
+            sbo_ptr_special_members() noexcept = default;
+            sbo_ptr_special_members(sbo_ptr_special_members const&) = delete;
+            sbo_ptr_special_members(sbo_ptr_special_members&&) noexcept = default;
+            auto operator=(sbo_ptr_special_members const&) -> sbo_ptr_special_members& = delete;
+            auto operator=(sbo_ptr_special_members&&) noexcept -> sbo_ptr_special_members& = default;
         };
 
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, true, false, true>
+        template <>
+        struct sbo_ptr_special_members<false, false>
+        {
+            sbo_ptr_special_members() noexcept = default;
+            sbo_ptr_special_members(sbo_ptr_special_members const&) = delete;
+            sbo_ptr_special_members(sbo_ptr_special_members&&) = delete;
+            auto operator=(sbo_ptr_special_members const&) -> sbo_ptr_special_members& = delete;
+            auto operator=(sbo_ptr_special_members&&) -> sbo_ptr_special_members& = delete;
+        };
+
+        // Construction, transfer and destruction of the held object, for every kind of pointer.
+        // The movable, copyable and allow_heap options select the storage and the vtable,
+        // and the branches taken below. The operations a kind does not support are only
+        // instantiated if used, which sbo_ptr_special_members prevents for the special members.
+        template <typename Base, std::size_t sbo_size, std::size_t sbo_align, sbo_ptr_options opts, typename Allocator, typename Members>
+        class sbo_ptr_base
+          : public sbo_ptr_allocator_storage<Allocator>,
+            public sbo_ptr_budget_storage<(opts & budgeted) != 0>,
+            public sbo_ptr_storage_for_opts<Base, sbo_size, sbo_align, opts, Allocator, Members>
         {
           public:
             sbo_ptr_base() noexcept = default;
 
-            sbo_ptr_base(sbo_ptr_base const&) = delete;
+            constexpr explicit sbo_ptr_base(Allocator const& alloc) noexcept
+              : sbo_ptr_allocator_storage<Allocator>{alloc}
+            {
+            }
+
+            sbo_ptr_base(sbo_ptr_base const& other)
+              : sbo_ptr_allocator_storage<Allocator>{
+                  alloc_traits::traits::select_on_container_copy_construction(other.allocator())}
+            {
+                construct_from(other);
+            }
+
+            sbo_ptr_base(std::allocator_arg_t, Allocator const& alloc, sbo_ptr_base const& other)
+              : sbo_ptr_allocator_storage<Allocator>{alloc}
+            {
+                construct_from(other);
+            }
 
             sbo_ptr_base(sbo_ptr_base&& other) noexcept
+              : sbo_ptr_allocator_storage<Allocator>{other.allocator()}
+            {
+                construct_from(std::move(other));
+            }
+
+            sbo_ptr_base(std::allocator_arg_t, Allocator const& alloc, sbo_ptr_base&& other) noexcept(!enable_heap || alloc_traits::is_always_equal)
+              : sbo_ptr_allocator_storage<Allocator>{alloc}
             {
                 construct_from(std::move(other));
             }
 
-            auto operator=(sbo_ptr_base const&) = delete;
-
-            auto operator=(sbo_ptr_base&& other) noexcept -> sbo_ptr_base&
+            auto operator=(sbo_ptr_base const& other) -> sbo_ptr_base&
+            {
+                if (this != &other)
+                {
+                    // Strong exception guarantee
+                    auto copy = sbo_ptr_base{
+                        std::allocator_arg,
+                        alloc_traits::propagate_on_copy_assignment ? other.allocator() : this->allocator(),
+                        other,
+                    };
+                    destroy();
+                    if constexpr (alloc_traits::propagate_on_copy_assignment)
+                    {
+                        this->allocator() = other.allocator();
+                    }
+                    construct_from(std::move(copy));
+                }
+                return *this;
+            }
+
+            auto operator=(sbo_ptr_base&& other) noexcept(!enable_heap || alloc_traits::propagate_on_move_assignment || alloc_traits::is_always_equal) -> sbo_ptr_base&
             {
                 if (this != &other)
                 {
                     destroy();
+                    if constexpr (alloc_traits::propagate_on_move_assignment)
+                    {
+                        this->allocator() = other.allocator();
+                    }
                     construct_from(std::move(other));
                 }
                 return *this;
             }
 
-            ~sbo_ptr_base() noexcept
+            SBOPTR_CONSTEXPR20 ~sbo_ptr_base() noexcept
             {
                 destroy();
             }
 
           protected:
-            Base* ptr_ = nullptr;
-            sbo_ptr_vtable<Base, true, false, true> const* vtable_ = nullptr;
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using storage = sbo_ptr_storage_for_opts<Base, sbo_size, sbo_align, opts, Allocator, Members>;
+
+            static constexpr bool enable_heap = (opts & allow_heap) != 0;
+            static constexpr bool is_cow = (opts & cow) != 0;
+            static constexpr bool is_budgeted = (opts & budgeted) != 0;
 
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, true, false, true, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, true, false, true, Derived, Args&&...>::value)
+            template <typename Derived, typename... Args>
+            SBOPTR_CONSTEXPR20 void construct(Args&&... args) noexcept(can_nothrow_emplace<sbo_size, sbo_align, opts, Derived, Args&&...>())
             {
-                if constexpr (sizeof(Derived) <= sbo_size)
+                if constexpr (fits_buffer<Derived, sbo_size, sbo_align>)
                 {
-                    ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
-                    vtable_ = sbo_ptr_vtable<Base, true, false, true>::template get<Derived, false>();
+                    auto* const ptr = construct_in_buffer<Derived>(std::forward<Args>(args)...);
+                    this->set(to_base<Base>(ptr), storage::template vtable_for<Derived>(ptr));
+                    count_construction<opts, Derived>(false);
                 }
                 else
                 {
-                    ptr_ = new Derived(std::forward<Args>(args)...);
-                    vtable_ = sbo_ptr_vtable<Base, true, false, true>::template get<Derived, true>();
+                    static_assert(
+                        enable_heap || sizeof(Derived) <= sbo_size,
+                        "Derived class is too big to store. Increase the small buffer size or allow heap allocations.");
+                    static_assert(
+                        enable_heap || alignof(Derived) <= sbo_align,
+                        "Derived class is over-aligned for the small buffer. Increase the buffer alignment or allow heap allocations.");
+                    if constexpr (enable_heap)
+                    {
+                        auto charge = heap_budget_charge<is_budgeted>{sizeof(Derived)};
+                        if (!charge)
+                        {
+                            throw std::bad_alloc{};
+                        }
+                        auto* const ptr = heap_new<Derived>(std::forward<Args>(args)...);
+                        this->set(to_base<Base>(ptr), storage::template vtable_for<Derived>(ptr), true);
+                        this->set_budget(charge.commit());
+                        count_construction<opts, Derived>(true);
+                    }
                 }
             }
 
-            void construct_from(sbo_ptr_base&& other) noexcept
+            void construct_from(sbo_ptr_base const& other)
             {
-                if (other.ptr_)
+                if (!other.empty())
                 {
-                    if (other.vtable_->on_heap)
+                    auto* const vtable = other.vtable();
+                    auto is_heap_copy = false;
+                    if (!other.on_heap())
                     {
-                        ptr_ = std::exchange(other.ptr_, nullptr);
+                        this->set(vtable->copy(other.buffer(), this->buffer(), this->allocator()), vtable);
                     }
-                    else
+                    else if constexpr (enable_heap)
                     {
-                        ptr_ = other.vtable_->move(&other.sbo_buffer_, &sbo_buffer_);
-                        other.ptr_ = nullptr;
+                        if (!share(other))
+                        {
+                            auto charge = heap_budget_charge<is_budgeted>{vtable->heap_object_size};
+                            if (!charge)
+                            {
+                                throw std::bad_alloc{};
+                            }
+                            this->set(vtable->heap_copy(other.ptr(), this->allocator()), vtable, true);
+                            this->set_budget(charge.commit());
+                            is_heap_copy = true;
+                        }
+                    }
+                    if constexpr (enable_heap && is_instrumented<opts>)
+                    {
+                        vtable->heap_stats->count_copy(is_heap_copy);
                     }
-                    vtable_ = std::exchange(other.vtable_, nullptr);
                 }
             }
 
-            void destroy() noexcept
+            // Only throws if the allocators differ, and a heap object has to be moved between them
+            void construct_from(sbo_ptr_base&& other) noexcept(!enable_heap || alloc_traits::is_always_equal)
             {
-                if (ptr_)
+                if (!other.empty())
                 {
-                    if (vtable_->on_heap)
+                    auto* const vtable = other.vtable();
+                    if constexpr (enable_heap && is_instrumented<opts>)
                     {
-                        delete std::exchange(ptr_, nullptr);
+                        vtable->heap_stats->count_move(other.on_heap() && !alloc_traits::equal(this->allocator(), other.allocator()));
                     }
-                    else
+                    if (!other.on_heap())
+                    {
+                        this->set(move_buffer<sbo_size, opts>(vtable, other.buffer(), this->buffer(), other.ptr()), vtable);
+                    }
+                    else if constexpr (enable_heap)
                     {
-                        std::exchange(ptr_, nullptr)->~Base();
+                        if (alloc_traits::equal(this->allocator(), other.allocator()))
+                        {
+                            // Heap objects just change owner, the vtable is not touched
+                            this->set(other.ptr(), vtable, true);
+                        }
+                        else
+                        {
+                            this->set(vtable->heap_move(other.ptr(), other.allocator(), this->allocator()), vtable, true);
+                        }
+                        this->set_budget(other.budget());
                     }
+                    other.clear();
                 }
             }
 
-          private:
-            std::aligned_storage_t<sbo_size> sbo_buffer_;
-        };
-
-        template <typename Base, std::size_t sbo_size>
-        class sbo_ptr_base<Base, sbo_size, true, true, true>
-        {
-          public:
-            sbo_ptr_base() noexcept = default;
-
-            sbo_ptr_base(sbo_ptr_base const& other)
-            {
-                construct_from(other);
-            }
-
-            sbo_ptr_base(sbo_ptr_base&& other) noexcept
-            {
-                construct_from(std::move(other));
-            }
-
-            auto operator=(sbo_ptr_base const& other) -> sbo_ptr_base&
+            // Destroys the object and constructs a Derived. Heap blocks are taken over
+            // by a Derived with the same block size, if its construction can not throw,
+            // unless the pointer is budgeted (the charge could differ).
+            template <typename Derived, typename... Args>
+            void replace(Args&&... args)
             {
-                if (this != &other)
+                if constexpr (enable_heap && !is_cow && !is_budgeted && reuses_heap_block<Derived, sbo_size, sbo_align, Allocator, Args&&...>)
                 {
-                    // Strong exception guarantee
-                    auto copy = other;
-                    destroy();
-                    construct_from(std::move(copy));
+                    auto* const vtable = this->vtable();
+                    if (this->on_heap()
+                        && vtable->heap_block_size == alloc_traits::template heap_block_size<Derived>()
+                        && vtable->heap_block_align == alignof(Derived))
+                    {
+                        auto* const block = vtable->heap_destroy(this->ptr(), this->allocator());
+                        auto* const ptr = alloc_traits::template construct<Derived>(this->allocator(), block, std::forward<Args>(args)...);
+                        this->set(to_base<Base>(ptr), storage::template vtable_for<Derived>(ptr), true);
+                        count_construction<opts, Derived>(true);
+                        return;
+                    }
                 }
-                return *this;
+                destroy();
+                construct<Derived>(std::forward<Args>(args)...);
             }
 
-            auto operator=(sbo_ptr_base&& other) noexcept -> sbo_ptr_base&
+            // Like replace, but a heap object over the budget of this thread, or
+            // out of memory, is reported instead of thrown. The object held is
+            // destroyed after the new one is constructed, so a failure changes nothing.
+            // Exceptions of the constructor propagate, except for types with their
+            // own operator new: their allocation and construction are one
+            // new-expression, so a std::bad_alloc of the constructor is reported too.
+            template <typename Derived, typename... Args>
+            auto try_replace(Args&&... args) noexcept(std::is_nothrow_constructible_v<Derived, Args&&...>) -> emplace_status
             {
-                if (this != &other)
+                if constexpr (!enable_heap || fits_buffer<Derived, sbo_size, sbo_align>)
                 {
+                    replace<Derived>(std::forward<Args>(args)...);
+                }
+                else
+                {
+                    auto charge = heap_budget_charge<is_budgeted>{sizeof(Derived)};
+                    if (!charge)
+                    {
+                        return emplace_status::over_budget;
+                    }
+                    auto* ptr = static_cast<Derived*>(nullptr);
+                    if constexpr (is_cow)
+                    {
+                        auto* const block = cow_try_allocate<Derived>(this->allocator());
+                        if (!block)
+                        {
+                            return emplace_status::out_of_memory;
+                        }
+                        ptr = cow_construct<Derived>(this->allocator(), block, std::forward<Args>(args)...);
+                    }
+                    else if constexpr (alloc_traits::template heap_block_size<Derived>() == 0)
+                    {
+                        // Class-specific allocation functions are only used
+                        // through a new-expression, so std::bad_alloc has to be caught
+                        try
+                        {
+                            ptr = heap_new<Derived>(std::forward<Args>(args)...);
+                        }
+                        catch (std::bad_alloc const&)
+                        {
+                            return emplace_status::out_of_memory;
+                        }
+                    }
+                    else
+                    {
+                        auto* const block = alloc_traits::template try_allocate<Derived>(this->allocator());
+                        if (!block)
+                        {
+                            return emplace_status::out_of_memory;
+                        }
+                        if constexpr (std::is_nothrow_constructible_v<Derived, Args&&...>)
+                        {
+                            ptr = alloc_traits::template construct<Derived>(this->allocator(), block, std::forward<Args>(args)...);
+                        }
+                        else
+                        {
+                            try
+                            {
+                                ptr = alloc_traits::template construct<Derived>(this->allocator(), block, std::forward<Args>(args)...);
+                            }
+                            catch (...)
+                            {
+                                alloc_traits::template deallocate<Derived>(this->allocator(), block);
+                                throw;
+                            }
+                        }
+                    }
                     destroy();
-                    construct_from(std::move(other));
+                    this->set(to_base<Base>(ptr), storage::template vtable_for<Derived>(ptr), true);
+                    this->set_budget(charge.commit());
+                    count_construction<opts, Derived>(true);
                 }
-                return *this;
+                return emplace_status::success;
             }
 
-            ~sbo_ptr_base() noexcept
+            SBOPTR_CONSTEXPR20 void destroy() noexcept
             {
-                destroy();
+                if (!this->empty())
+                {
+                    auto* const ptr = this->ptr();
+                    auto* const vtable = this->vtable();
+                    if (!this->on_heap())
+                    {
+                        this->clear();
+                        destroy_in_place(vtable, ptr);
+                    }
+                    else if constexpr (enable_heap)
+                    {
+                        this->clear();
+                        vtable->heap_delete(ptr, this->allocator());
+                        if (auto* const budget = this->budget())
+                        {
+                            budget->release(vtable->heap_object_size);
+                        }
+                    }
+                }
             }
 
-          protected:
-            Base* ptr_ = nullptr;
-            sbo_ptr_vtable<Base, true, true, true> const* vtable_ = nullptr;
-
-            template <typename Derived,
-                      typename... Args,
-                      typename = std::enable_if_t<can_emplace<Base, sbo_size, true, true, true, Derived, Args&&...>::value>>
-            void construct(Args&&... args) noexcept(can_nothrow_emplace<Base, sbo_size, true, true, true, Derived, Args&&...>::value)
+            // Whether the heap object is also owned by other pointers
+            [[nodiscard]] auto is_shared() const noexcept -> bool
             {
-                if constexpr (sizeof(Derived) <= sbo_size)
+                if constexpr (is_cow)
                 {
-                    ptr_ = new (&sbo_buffer_) Derived(std::forward<Args>(args)...);
-                    vtable_ = sbo_ptr_vtable<Base, true, true, true>::template get<Derived, false>();
+                    return this->on_heap() && this->vtable()->cow_refs(this->ptr()).load(std::memory_order_acquire) != 1;
                 }
                 else
                 {
-                    ptr_ = new Derived(std::forward<Args>(args)...);
-                    vtable_ = sbo_ptr_vtable<Base, true, true, true>::template get<Derived, true>();
+                    return false;
                 }
             }
 
-            void construct_from(sbo_ptr_base const& other)
+            // Gives a shared heap object a copy of its own, before it is modified
+            void unshare()
             {
-                if (other.ptr_)
+                if (is_shared())
                 {
-                    if (other.vtable_->on_heap)
-                    {
-                        ptr_ = other.vtable_->heap_copy(other.ptr_);
-                    }
-                    else
+                    auto* const ptr = this->ptr();
+                    auto* const vtable = this->vtable();
+                    this->set(vtable->heap_copy(ptr, this->allocator()), vtable, true);
+                    vtable->heap_delete(ptr, this->allocator());
+                    if constexpr (is_instrumented<opts>)
                     {
-                        ptr_ = other.vtable_->copy(&other.sbo_buffer_, &sbo_buffer_);
+                        vtable->heap_stats->count_copy(true);
                     }
-                    vtable_ = other.vtable_;
                 }
             }
 
-            void construct_from(sbo_ptr_base&& other) noexcept
+          private:
+            // Listed types are constructed in their member of the buffer, which
+            // also works in constant expressions, unless the allocator takes part
+            template <typename Derived, typename... Args>
+            SBOPTR_CONSTEXPR20 auto construct_in_buffer(Args&&... args) -> Derived*
             {
-                if (other.ptr_)
+                if constexpr (alloc_traits::is_default && storage::template has_member<Derived>)
                 {
-                    if (other.vtable_->on_heap)
-                    {
-                        ptr_ = std::exchange(other.ptr_, nullptr);
-                    }
-                    else
-                    {
-                        ptr_ = other.vtable_->move(&other.sbo_buffer_, &sbo_buffer_);
-                        other.ptr_ = nullptr;
-                    }
-                    vtable_ = std::exchange(other.vtable_, nullptr);
+                    return this->template construct_member<Derived>(std::forward<Args>(args)...);
+                }
+                else
+                {
+                    return alloc_traits::template construct<Derived>(this->allocator(), this->buffer(), std::forward<Args>(args)...);
                 }
             }
 
-            void destroy() noexcept
+            template <typename Derived, typename... Args>
+            auto heap_new(Args&&... args) -> Derived*
             {
-                if (ptr_)
+                if constexpr (is_cow)
                 {
-                    if (vtable_->on_heap)
-                    {
-                        delete std::exchange(ptr_, nullptr);
-                    }
-                    else
+                    return cow_heap_new<Derived>(this->allocator(), std::forward<Args>(args)...);
+                }
+                else
+                {
+                    return alloc_traits::template heap_new<Derived>(this->allocator(), std::forward<Args>(args)...);
+                }
+            }
+
+            // With the cow option, copies share heap objects if the allocators compare equal
+            auto share(sbo_ptr_base const& other) noexcept -> bool
+            {
+                if constexpr (is_cow)
+                {
+                    if (alloc_traits::equal(this->allocator(), other.allocator()))
                     {
-                        std::exchange(ptr_, nullptr)->~Base();
+                        other.vtable()->cow_refs(other.ptr()).fetch_add(1, std::memory_order_relaxed);
+                        this->set(other.ptr(), other.vtable(), true);
+                        return true;
                     }
                 }
+                return false;
             }
-
-          private:
-            std::aligned_storage_t<sbo_size> sbo_buffer_;
         };
 
-        template <typename T, std::size_t sbo_size, sbo_ptr_options opts>
-        using sbo_ptr_base_for_opts = sbo_ptr_base<T, sbo_size, opts & movable, opts & copyable, opts & allow_heap>;
+        template <sbo_ptr_options opts, typename Allocator>
+        using sbo_ptr_allocator_for_opts = std::conditional_t<(opts & pooled) != 0, pool_allocator<std::byte>, Allocator>;
+
+        // Range algorithms working on the storage directly (in sboptr/algorithm.hpp)
+        struct sbo_ptr_algorithms;
+
+        template <typename T, std::size_t sbo_size, std::size_t sbo_align, sbo_ptr_options opts, typename Allocator, typename Members>
+        using sbo_ptr_base_for_opts = sbo_ptr_base<T, sbo_size, sbo_align, opts, sbo_ptr_allocator_for_opts<opts, Allocator>, Members>;
     }  // namespace detail
 
-    template <typename T, std::size_t sbo_size, sbo_ptr_options opts>
-    class basic_sbo_ptr : private detail::sbo_ptr_base_for_opts<T, sbo_size, opts>
+    // Objects needing more than sbo_align alignment are stored on the heap,
+    // like those bigger than sbo_size. With the cache_aligned option, the whole
+    // pointer takes up separate cache lines, so that pointers next to each
+    // other can be written by different threads without false sharing.
+    // Members lists the types given to the _for aliases (in C++20).
+    template <typename T,
+              std::size_t sbo_size,
+              sbo_ptr_options opts,
+              typename Allocator = default_allocator,
+              std::size_t sbo_align = detail::default_sbo_alignment<T, sbo_size, opts>,
+              typename Members = detail::buffer_members<>>
+    class alignas((opts & cache_aligned) != 0
+                      ? std::max(cache_line_size, alignof(detail::sbo_ptr_base_for_opts<T, sbo_size, sbo_align, opts, Allocator, Members>))
+                      : alignof(detail::sbo_ptr_base_for_opts<T, sbo_size, sbo_align, opts, Allocator, Members>)) basic_sbo_ptr
+      : private detail::sbo_ptr_base_for_opts<T, sbo_size, sbo_align, opts, Allocator, Members>,
+        private detail::sbo_ptr_special_members<(opts & movable) != 0, (opts & copyable) != 0>
     {
       private:
-        using Base = detail::sbo_ptr_base_for_opts<T, sbo_size, opts>;
+        using Base = detail::sbo_ptr_base_for_opts<T, sbo_size, sbo_align, opts, Allocator, Members>;
+
+        static_assert(sbo_align != 0 && (sbo_align & (sbo_align - 1)) == 0, "The buffer alignment must be a power of two.");
+
+        static_assert(
+            !(opts & pooled) || detail::is_std_allocator<Allocator>::value,
+            "The pooled option provides its own allocator, it can not be combined with a custom one.");
+        static_assert(
+            !(opts & copyable) || (opts & movable),
+            "Copyable pointers have to be movable as well.");
+        static_assert(
+            !(opts & cow) || ((opts & copyable) && (opts & allow_heap)),
+            "Copy-on-write only applies to heap objects of copyable pointers.");
+        static_assert(
+            !(opts & budgeted) || ((opts & allow_heap) && !(opts & cow)),
+            "Budgets apply to heap objects, which copy-on-write pointers share.");
+
+        // Non-const access first unshares heap objects of cow pointers
+        static constexpr bool is_cow = (opts & cow) != 0;
 
       public:
-        using pointer = T*;
-        using element_type = T;
+        // Objects of external pointers are only reached through ops()
+        using element_type = std::conditional_t<detail::is_external<T>::value, void, T>;
+        using pointer = element_type*;
+        using allocator_type = detail::sbo_ptr_allocator_for_opts<opts, Allocator>;
+        using operations_type = detail::operations_t<T>;
+
+        // The pointer is trivially relocatable itself only if everything it can hold is,
+        // and it does not point into its own buffer.
+        // Nested IsRelocatable is the folly spelling of the trait.
+        using IsRelocatable = std::bool_constant<(opts & movable) && (opts & trivially_relocatable) && !Base::self_referential>;
+
+        // Whether objects of type U are constructed in the small buffer
+        template <typename U>
+        static constexpr bool stores_inline = detail::fits_buffer<U, sbo_size, sbo_align>;
+
+        // Whether adopt and release_to_unique are available: heap objects are
+        // then allocated with plain new, like std::unique_ptr expects
+        static constexpr bool interoperates_with_unique_ptr = (opts & movable) && (opts & allow_heap) && !is_cow
+                                                              && detail::sbo_ptr_alloc_traits<allocator_type>::is_default;
 
         basic_sbo_ptr() noexcept = default;
 
-        basic_sbo_ptr(std::nullptr_t) noexcept { }
+        constexpr basic_sbo_ptr(std::nullptr_t) noexcept { }
 
-        using Base::Base;
+        constexpr explicit basic_sbo_ptr(allocator_type const& alloc) noexcept
+          : Base{alloc}
+        {
+        }
+
+        constexpr basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc) noexcept
+          : Base{alloc}
+        {
+        }
+
+        constexpr basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, std::nullptr_t) noexcept
+          : Base{alloc}
+        {
+        }
+
+        template <sbo_ptr_options o = opts, typename = std::enable_if_t<(o & copyable) != 0>>
+        basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, basic_sbo_ptr const& other)
+          : Base{std::allocator_arg, alloc, other}
+        {
+        }
+
+        template <sbo_ptr_options o = opts, typename = std::enable_if_t<(o & movable) != 0>>
+        basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, basic_sbo_ptr&& other) noexcept(std::is_nothrow_constructible_v<Base, std::allocator_arg_t, allocator_type const&, Base&&>)
+          : Base{std::allocator_arg, alloc, std::move(other)}
+        {
+        }
+
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<
+                      detail::can_emplace<T, opts, U, Args&&...>()>>
+        SBOPTR_CONSTEXPR20 basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, std::in_place_type_t<U>, Args&&... args) noexcept(detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, Args&&...>())
+          : Base{alloc}
+        {
+            Base::template construct<U>(std::forward<Args>(args)...);
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<
+                      !std::is_same_v<std::decay_t<U>, basic_sbo_ptr> && detail::can_emplace<T, opts, std::decay_t<U>, U&&>()>>
+        SBOPTR_CONSTEXPR20 basic_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, U&& value) noexcept(detail::can_nothrow_emplace<sbo_size, sbo_align, opts, std::decay_t<U>, U&&>())
+          : basic_sbo_ptr{std::allocator_arg, alloc, std::in_place_type<std::decay_t<U>>, std::forward<U>(value)}
+        {
+        }
 
         template <typename U,
                   typename... Args,
                   typename = std::enable_if_t<
-                      detail::can_emplace_opts<T, sbo_size, opts, U, Args&&...>::value>>
-        explicit basic_sbo_ptr(std::in_place_type_t<U>, Args&&... args) noexcept(detail::can_nothrow_emplace_opts<T, sbo_size, opts, U, Args&&...>::value)
+                      detail::can_emplace<T, opts, U, Args&&...>()>>
+        SBOPTR_CONSTEXPR20 explicit basic_sbo_ptr(std::in_place_type_t<U>, Args&&... args) noexcept(detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, Args&&...>())
         {
             Base::template construct<U>(std::forward<Args>(args)...);
         }
 
         template <typename U,
                   typename = std::enable_if_t<
-                      !std::is_same_v<std::decay_t<U>, basic_sbo_ptr> && detail::can_emplace_opts<T, sbo_size, opts, std::decay_t<U>, U&&>::value>>
-        basic_sbo_ptr(U&& value) noexcept(detail::can_nothrow_emplace_opts<T, sbo_size, opts, std::decay_t<U>, U&&>::value)
+                      !std::is_same_v<std::decay_t<U>, basic_sbo_ptr> && detail::can_emplace<T, opts, std::decay_t<U>, U&&>()>>
+        SBOPTR_CONSTEXPR20 basic_sbo_ptr(U&& value) noexcept(detail::can_nothrow_emplace<sbo_size, sbo_align, opts, std::decay_t<U>, U&&>())
           : basic_sbo_ptr{std::in_place_type<std::decay_t<U>>, std::forward<U>(value)}
         {
         }
 
+        // An object of the same type is assigned to, instead of being replaced
         template <typename U,
                   typename = std::enable_if_t<
-                      std::is_same_v<U, std::decay_t<U>> && !std::is_same_v<U, basic_sbo_ptr> && detail::can_emplace_opts<T, sbo_size, opts, std::decay_t<U>, U&&>::value>>
-        auto operator=(U&& other) noexcept -> basic_sbo_ptr&
+                      std::is_same_v<U, std::decay_t<U>> && !std::is_same_v<U, basic_sbo_ptr> && detail::can_emplace<T, opts, std::decay_t<U>, U&&>()>>
+        auto operator=(U&& other) noexcept(
+            detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, U&&>()
+            && (!std::is_move_assignable_v<U> || std::is_nothrow_move_assignable_v<U>)) -> basic_sbo_ptr&
         {
-            Base::destroy();
-            Base::template construct<U>(std::forward<U>(other));
+            if constexpr (std::is_move_assignable_v<U>)
+            {
+                if (assigns_in_place<U>())
+                {
+                    *detail::to_derived<U>(Base::ptr()) = std::move(other);
+                    return *this;
+                }
+            }
+            replace<U>(std::move(other));
             return *this;
         }
 
         template <typename U,
                   typename = std::enable_if_t<
-                      !std::is_same_v<U, basic_sbo_ptr> && detail::can_emplace_opts<T, sbo_size, opts, U, U const&>::value>>
-        auto operator=(U const& other) noexcept(detail::can_nothrow_emplace_opts<T, sbo_size, opts, U, U const&>::value) -> basic_sbo_ptr&
+                      !std::is_same_v<U, basic_sbo_ptr> && detail::can_emplace<T, opts, U, U const&>()>>
+        auto operator=(U const& other) noexcept(
+            detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, U const&>()
+            && (!std::is_copy_assignable_v<U> || std::is_nothrow_copy_assignable_v<U>)) -> basic_sbo_ptr&
         {
-            // Strong exception guarantee
-            return (*this = U{other});
+            if constexpr (std::is_copy_assignable_v<U>)
+            {
+                if (assigns_in_place<U>())
+                {
+                    // As exception safe as the copy assignment of U
+                    *detail::to_derived<U>(Base::ptr()) = other;
+                    return *this;
+                }
+            }
+            if constexpr (detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, U const&>())
+            {
+                replace<U>(other);
+                return *this;
+            }
+            else if constexpr (detail::fits_buffer<U, sbo_size, sbo_align>)
+            {
+                // Strong exception guarantee, the buffer is only free once the object held is gone
+                return (*this = U{other});
+            }
+            else
+            {
+                // Strong exception guarantee without a temporary: other is copied
+                // into a new heap block before the object held is destroyed
+                if (Base::template try_replace<U>(other) != emplace_status::success)
+                {
+                    throw std::bad_alloc{};
+                }
+                return *this;
+            }
         }
 
         auto operator=(std::nullptr_t) noexcept -> basic_sbo_ptr&
@@ -731,12 +2761,22 @@ namespace sboptr
 
         template <typename U,
                   typename... Args,
-                  typename = std::enable_if_t<detail::can_emplace_opts<T, sbo_size, opts, U, Args&&...>::value>>
-        void emplace(Args&&... args) noexcept(detail::can_nothrow_emplace_opts<T, sbo_size, opts, U, Args&&...>::value)
+                  typename = std::enable_if_t<detail::can_emplace<T, opts, U, Args&&...>()>>
+        void emplace(Args&&... args) noexcept(detail::can_nothrow_emplace<sbo_size, sbo_align, opts, U, Args&&...>())
         {
             // Emplace cannot provide strong exception guarantee
-            Base::destroy();
-            Base::template construct<U>(std::forward<Args>(args)...);
+            replace<U>(std::forward<Args>(args)...);
+        }
+
+        // Like emplace, but a heap object over the heap_budget or out of memory
+        // is reported, leaving the pointer unchanged. Exceptions of the
+        // constructor of U are still thrown.
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<detail::can_emplace<T, opts, U, Args&&...>()>>
+        [[nodiscard]] auto try_emplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<U, Args&&...>) -> emplace_status
+        {
+            return Base::template try_replace<U>(std::forward<Args>(args)...);
         }
 
         void reset() noexcept
@@ -744,32 +2784,136 @@ namespace sboptr
             Base::destroy();
         }
 
-        [[nodiscard]] auto get() noexcept -> T*
+        // Takes ownership of a heap object without moving or allocating. The vtable
+        // is chosen by the static type, so the object must be exactly of type U;
+        // this is asserted for polymorphic types when RTTI is available.
+        template <typename U,
+                  typename = std::enable_if_t<detail::can_emplace<T, opts, U, U&&>()>>
+        void adopt(std::unique_ptr<U> object) noexcept
+        {
+            static_assert(
+                interoperates_with_unique_ptr,
+                "Only movable pointers with heap fallback, the default allocator and without copy-on-write can adopt objects.");
+            Base::destroy();
+            if (object)
+            {
+                SBOPTR_ASSERT(detail::is_most_derived(*object));
+                auto* const ptr = object.release();
+                Base::set(detail::to_base<T>(ptr), Base::vtable_for(ptr), true);
+                // Not charged to a budget
+                Base::set_budget(nullptr);
+            }
+        }
+
+        // Hands the object over without copying it; an object in the small buffer
+        // is moved to the heap first. If that throws, the pointer is unchanged.
+        [[nodiscard]] auto release_to_unique() -> std::unique_ptr<T>
+        {
+            static_assert(
+                interoperates_with_unique_ptr,
+                "Only movable pointers with heap fallback, the default allocator and without copy-on-write can release objects.");
+            static_assert(std::has_virtual_destructor_v<T>, "std::unique_ptr<T> deletes the object through T.");
+            if (Base::empty())
+            {
+                return nullptr;
+            }
+            auto* ptr = Base::ptr();
+            if (Base::on_heap())
+            {
+                if (auto* const budget = Base::budget())
+                {
+                    budget->release(Base::vtable()->heap_object_size);
+                }
+            }
+            else
+            {
+                auto* const vtable = Base::vtable();
+                ptr = vtable->move_to_heap(ptr, Base::allocator());
+                if constexpr (detail::is_instrumented<opts>)
+                {
+                    vtable->heap_stats->count_move(true);
+                }
+            }
+            Base::clear();
+            return std::unique_ptr<T>{ptr};
+        }
+
+        [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+        {
+            return Base::allocator();
+        }
+
+        // With the cow option, copies a shared object first (as do the
+        // other non-const accessors), so the result can be modified
+        [[nodiscard]] auto get() noexcept(!is_cow) -> element_type*
+        {
+            if constexpr (is_cow)
+            {
+                Base::unshare();
+            }
+            return Base::ptr();
+        }
+
+        [[nodiscard]] auto get() const noexcept -> element_type const*
         {
-            return Base::ptr_;
+            return Base::ptr();
         }
 
-        [[nodiscard]] auto get() const noexcept -> T const*
+        // Operations of the held object, filled in for its type by
+        // sbo_ptr_operations<T> (or Ops, for external<Ops>). The pointer must not be empty.
+        [[nodiscard]] auto ops() const noexcept -> operations_type const&
         {
-            return Base::ptr_;
+            return *Base::vtable();
         }
 
-        [[nodiscard]] auto operator*() noexcept -> T&
+        // Whether the held object is exactly of type U, without RTTI
+        template <typename U>
+        [[nodiscard]] auto holds() const noexcept -> bool
+        {
+            static_assert(detail::is_external<T>::value || std::is_base_of_v<T, U>, "U must be derived from the pointer type.");
+            if constexpr ((opts & movable) && !detail::can_emplace<T, opts, U, U&&>())
+            {
+                // Such objects can never be stored (and have no vtable)
+                return false;
+            }
+            else
+            {
+                return Base::template holds<U>();
+            }
+        }
+
+        // The held object if it is exactly of type U, nullptr otherwise.
+        // With the cow option, a shared object of type U is copied first.
+        template <typename U>
+        [[nodiscard]] auto get_if() noexcept(!is_cow) -> U*
+        {
+            return holds<U>() ? static_cast<U*>(get()) : nullptr;
+        }
+
+        template <typename U>
+        [[nodiscard]] auto get_if() const noexcept -> U const*
+        {
+            return holds<U>() ? static_cast<U const*>(get()) : nullptr;
+        }
+
+        template <typename U = element_type, typename = std::enable_if_t<!std::is_void_v<U>>>
+        [[nodiscard]] auto operator*() noexcept(!is_cow) -> U&
         {
             return *get();
         }
 
-        [[nodiscard]] auto operator*() const noexcept -> T const&
+        template <typename U = element_type, typename = std::enable_if_t<!std::is_void_v<U>>>
+        [[nodiscard]] auto operator*() const noexcept -> U const&
         {
             return *get();
         }
 
-        [[nodiscard]] auto operator->() noexcept -> T*
+        [[nodiscard]] auto operator->() noexcept(!is_cow) -> element_type*
         {
             return get();
         }
 
-        [[nodiscard]] auto operator->() const noexcept -> T const*
+        [[nodiscard]] auto operator->() const noexcept -> element_type const*
         {
             return get();
         }
@@ -779,19 +2923,29 @@ namespace sboptr
             return *this != nullptr;
         }
 
+        // Compares object identity. Copies of cow pointers hold distinct objects
+        // as far as their owners can tell, even while they share one, so they
+        // compare unequal like copies of other pointers, whatever the sharing state.
         [[nodiscard]] friend auto operator==(basic_sbo_ptr const& lhs, basic_sbo_ptr const& rhs) noexcept -> bool
         {
-            return lhs.get() == rhs.get();
+            if constexpr (is_cow)
+            {
+                return &lhs == &rhs || (lhs.get() == nullptr && rhs.get() == nullptr);
+            }
+            else
+            {
+                return lhs.get() == rhs.get();
+            }
         }
 
         [[nodiscard]] friend auto operator==(basic_sbo_ptr const& lhs, std::nullptr_t) noexcept -> bool
         {
-            return lhs.ptr_ == nullptr;
+            return lhs.get() == nullptr;
         }
 
         [[nodiscard]] friend auto operator==(std::nullptr_t, basic_sbo_ptr const& rhs) noexcept -> bool
         {
-            return rhs.ptr_ == nullptr;
+            return rhs.get() == nullptr;
         }
 
         [[nodiscard]] friend auto operator!=(basic_sbo_ptr const& lhs, basic_sbo_ptr const& rhs) noexcept -> bool
@@ -808,23 +2962,189 @@ namespace sboptr
         {
             return !(nullptr == rhs);
         }
+
+      private:
+        friend struct detail::sbo_ptr_algorithms;
+
+        // Shared objects of cow pointers are replaced instead
+        template <typename U>
+        [[nodiscard]] auto assigns_in_place() const noexcept -> bool
+        {
+            if constexpr (is_cow)
+            {
+                return holds<U>() && !Base::is_shared();
+            }
+            else
+            {
+                return holds<U>();
+            }
+        }
+
+        template <typename U, typename... Args>
+        void replace(Args&&... args)
+        {
+            Base::template replace<U>(std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+    struct is_trivially_relocatable<basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>>
+      : basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>::IsRelocatable
+    {
     };
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using pinned_sbo_ptr = basic_sbo_ptr<T, sbo_size, allow_heap>;
+    namespace detail
+    {
+        template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator, std::size_t sbo_align, typename Members>
+        struct is_sbo_ptr<basic_sbo_ptr<T, sbo_size, opts, Allocator, sbo_align, Members>> : std::true_type
+        {
+        };
+
+        template <typename R, typename U, typename... Us, typename Ptr, typename Visitor>
+        auto visit_chain(Ptr& ptr, Visitor& visitor) -> R
+        {
+            if (auto* const object = ptr.template get_if<U>())
+            {
+                return std::invoke(visitor, *object);
+            }
+            if constexpr (sizeof...(Us) == 0)
+            {
+                return std::invoke(visitor, *ptr);
+            }
+            else
+            {
+                return visit_chain<R, Us...>(ptr, visitor);
+            }
+        }
+    }  // namespace detail
+
+    // Calls visitor with the object as its concrete type, if it is one of Us,
+    // otherwise with the pointer's element type. The types are tried in order,
+    // each costs a pointer comparison. The pointer must not be empty.
+    // A non-const cow pointer copies a shared object first, pass it as const to only read.
+    template <typename... Us, typename Ptr, typename Visitor>
+    auto visit(Ptr&& ptr, Visitor&& visitor) -> std::invoke_result_t<Visitor&, decltype(*ptr)>
+    {
+        using result_type = std::invoke_result_t<Visitor&, decltype(*ptr)>;
+        if constexpr (sizeof...(Us) == 0)
+        {
+            return std::invoke(visitor, *ptr);
+        }
+        else
+        {
+            return detail::visit_chain<result_type, Us...>(ptr, visitor);
+        }
+    }
+
+    namespace detail
+    {
+        // Small buffer size holding any of Ds
+        template <typename T, typename... Ds>
+        struct sbo_size_for
+        {
+            static_assert(sizeof...(Ds) > 0, "At least one type must be listed.");
+            static_assert((std::is_base_of_v<T, Ds> && ...), "The listed types must be derived from the pointer type.");
+
+            static constexpr auto value = std::max({sizeof(Ds)...});
+        };
+
+        template <typename T, typename... Ds>
+        inline constexpr auto sbo_size_for_v = sbo_size_for<T, Ds...>::value;
+
+        // Never below the default, so that the layout only differs
+        // from the manually sized one if some of Ds are over-aligned
+        template <typename T, sbo_ptr_options opts, typename... Ds>
+        inline constexpr auto sbo_align_for_v = std::max({default_sbo_alignment<T, sbo_size_for_v<T, Ds...>, opts>, alignof(Ds)...});
+
+        // In C++20, the buffer has a member for each of Ds, so that they can
+        // be constructed in constant expressions
+#ifdef SBOPTR_HAS_CONSTEXPR_CONSTRUCTION
+        template <typename... Ds>
+        using buffer_members_for = buffer_members<Ds...>;
+#else
+        template <typename... Ds>
+        using buffer_members_for = buffer_members<>;
+#endif
+
+        template <typename T, sbo_ptr_options opts, typename Allocator, typename... Ds>
+        using basic_sbo_ptr_for = basic_sbo_ptr<T, sbo_size_for_v<T, Ds...>, opts, Allocator, sbo_align_for_v<T, opts, Ds...>, buffer_members_for<Ds...>>;
+    }  // namespace detail
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using pinned_sbo_ptr = basic_sbo_ptr<T, sbo_size, allow_heap, Allocator>;
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using pinned_no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, no_options, Allocator>;
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using unique_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | allow_heap, Allocator>;
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using unique_no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable, Allocator>;
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | copyable | allow_heap, Allocator>;
+
+    template <typename T, std::size_t sbo_size = sizeof(T), typename Allocator = default_allocator>
+    using no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | copyable, Allocator>;
+
+    // Pointers with a small buffer sized and aligned for all of Ds, so that
+    // the listed types are always stored in place. The no_alloc variants
+    // also reject any other type that does not fit at compile time.
+    template <typename T, typename... Ds>
+    using pinned_sbo_ptr_for = detail::basic_sbo_ptr_for<T, allow_heap, default_allocator, Ds...>;
+
+    template <typename T, typename... Ds>
+    using pinned_no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, no_options, default_allocator, Ds...>;
+
+    template <typename T, typename... Ds>
+    using unique_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | allow_heap, default_allocator, Ds...>;
+
+    template <typename T, typename... Ds>
+    using unique_no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable, default_allocator, Ds...>;
+
+    template <typename T, typename... Ds>
+    using sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | copyable | allow_heap, default_allocator, Ds...>;
+
+    template <typename T, typename... Ds>
+    using no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | copyable, default_allocator, Ds...>;
+
+    namespace pmr
+    {
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using pinned_sbo_ptr = sboptr::pinned_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using pinned_no_alloc_sbo_ptr = sboptr::pinned_no_alloc_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using unique_sbo_ptr = sboptr::unique_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using unique_no_alloc_sbo_ptr = sboptr::unique_no_alloc_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using sbo_ptr = sboptr::sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, std::size_t sbo_size = sizeof(T)>
+        using no_alloc_sbo_ptr = sboptr::no_alloc_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+
+        template <typename T, typename... Ds>
+        using pinned_sbo_ptr_for = detail::basic_sbo_ptr_for<T, allow_heap, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using pinned_no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, no_options>;
+        template <typename T, typename... Ds>
+        using pinned_no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, no_options, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using unique_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | allow_heap>;
+        template <typename T, typename... Ds>
+        using unique_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | allow_heap, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using unique_no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable>;
+        template <typename T, typename... Ds>
+        using unique_no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | copyable | allow_heap>;
+        template <typename T, typename... Ds>
+        using sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | copyable | allow_heap, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
 
-    template <typename T, std::size_t sbo_size = sizeof(T)>
-    using no_alloc_sbo_ptr = basic_sbo_ptr<T, sbo_size, movable | copyable>;
+        template <typename T, typename... Ds>
+        using no_alloc_sbo_ptr_for = detail::basic_sbo_ptr_for<T, movable | copyable, std::pmr::polymorphic_allocator<std::byte>, Ds...>;
+    }  // namespace pmr
 }  // namespace sboptr
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sboptr/sboptr.hpp"
+
+namespace sboptr
+{
+    namespace detail
+    {
+        // Operations of seqlock_sbo_ptr on one Derived type.
+        // Not the copy entry of sbo_ptr_vtable: readers take the bytes of inline
+        // values while a store may be overwriting them, and a copy constructor run
+        // on such bytes could follow torn pointers before the sequence check fails.
+        // So only bitwise copyable values are stored inline, and load copies from
+        // a checked image. It also emplaces into the returned pointer, as the copy
+        // entry only fills a small buffer and the pointer's storage is private.
+        template <typename Allocator, typename Ptr>
+        struct seqlock_vtable
+        {
+            // Copies the object into a regular pointer
+            void (*load)(void const*, Ptr&);
+            void (*destroy)(void*) noexcept;
+            void (*heap_delete)(void*, Allocator&) noexcept;
+
+            template <typename Derived>
+            static auto get() noexcept -> seqlock_vtable const*
+            {
+                static constexpr auto vtable = seqlock_vtable{
+                    [](void const* const object, Ptr& into) {
+                        into.template emplace<Derived>(*std::launder(static_cast<Derived const*>(object)));
+                    },
+                    [](void* const object) noexcept {
+                        std::launder(static_cast<Derived*>(object))->~Derived();
+                    },
+                    [](void* const object, Allocator& alloc) noexcept {
+                        sbo_ptr_alloc_traits<Allocator>::heap_delete(alloc, static_cast<Derived*>(object));
+                    },
+                };
+                return &vtable;
+            }
+        };
+    }  // namespace detail
+
+    // Holds one polymorphic value that a single writer replaces while any
+    // number of readers take copies of it, without locks.
+    // Bitwise copyable values that fit the buffer are published in place and
+    // read under a sequence counter, retrying if a store overlapped; such reads
+    // write no shared memory. Other values live on the heap and are never
+    // modified once published. Readers of heap values register in the reader
+    // count of the current epoch; the writer advances the epoch once the
+    // readers of the previous one are gone, and frees a replaced value once
+    // the readers of the epoch it was retired in are gone. So reads never block
+    // writes, writes never block reads, and a replaced value is freed once the
+    // reads that overlapped its retirement are done, even if new reads keep coming.
+    template <typename T, std::size_t sbo_size, typename Allocator = default_allocator>
+    class seqlock_sbo_ptr : private detail::sbo_ptr_allocator_storage<Allocator>
+    {
+      public:
+        using element_type = T;
+        using allocator_type = Allocator;
+        // Type of the copies returned by load
+        using value_type = sbo_ptr<T, sbo_size, Allocator>;
+
+      private:
+        using allocator_storage = detail::sbo_ptr_allocator_storage<Allocator>;
+        using alloc_traits = detail::sbo_ptr_alloc_traits<Allocator>;
+        using vtable_type = detail::seqlock_vtable<Allocator, value_type>;
+        using word = std::uintptr_t;
+
+        static_assert(std::atomic<word>::is_always_lock_free);
+
+        static constexpr auto word_count = std::max(std::size_t{1}, (sbo_size + sizeof(word) - 1) / sizeof(word));
+        static constexpr auto buffer_size = word_count * sizeof(word);
+        static constexpr auto buffer_align = alignof(std::aligned_storage_t<buffer_size>);
+
+        // Byte image of a published value: the object itself,
+        // or for heap values, the object pointer
+        struct alignas(buffer_align) snapshot
+        {
+            std::byte bytes[buffer_size] = {};
+        };
+
+        struct retired
+        {
+            vtable_type const* vtable;
+            void* object;
+            // Epoch in which the value stopped being published
+            std::uint64_t epoch = 0;
+        };
+
+        // Readers of heap values in the epochs of one parity, on a cache line of its own
+        struct alignas(cache_line_size) reader_count
+        {
+            std::atomic<std::size_t> count{0};
+        };
+
+        using retired_alloc = typename alloc_traits::template rebind_alloc<retired>;
+
+      public:
+        template <typename U>
+        static constexpr bool stores_inline = detail::fits_buffer<U, sbo_size, buffer_align> && is_bitwise_copyable_v<U>;
+
+        seqlock_sbo_ptr() noexcept = default;
+
+        explicit seqlock_sbo_ptr(allocator_type const& alloc) noexcept
+          : allocator_storage{alloc},
+            retired_{retired_alloc{alloc}}
+        {
+        }
+
+        seqlock_sbo_ptr(seqlock_sbo_ptr const&) = delete;
+        seqlock_sbo_ptr(seqlock_sbo_ptr&&) = delete;
+        auto operator=(seqlock_sbo_ptr const&) = delete;
+        auto operator=(seqlock_sbo_ptr&&) = delete;
+
+        // No reader may be in progress
+        ~seqlock_sbo_ptr() noexcept
+        {
+            release_current();
+            free_retired();
+        }
+
+        // Replaces the value; only one thread may store at a time.
+        // If the constructor (or an allocation) throws, the old value stays published.
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<detail::can_emplace<T, movable | copyable | allow_heap, U, Args&&...>()>>
+        void emplace(Args&&... args)
+        {
+            // The slots for retiring the old value and, later, the new one are
+            // reserved up front, so that retiring never allocates
+            retired_.reserve(retired_.size() + (current_on_heap_ ? 1 : 0) + (stores_inline<U> ? 0 : 1));
+
+            auto const* const vtable = vtable_type::template get<U>();
+            auto image = snapshot{};
+            if constexpr (stores_inline<U>)
+            {
+                alloc_traits::template construct<U>(this->allocator(), image.bytes, std::forward<Args>(args)...);
+                publish(vtable, image, false);
+                release_current();
+                // Bitwise copyable, so the published image can become the writer's copy
+                std::memcpy(&current_object_, image.bytes, buffer_size);
+                current_ = {vtable, &current_object_};
+            }
+            else
+            {
+                auto* const object = alloc_traits::template heap_new<U>(this->allocator(), std::forward<Args>(args)...);
+                auto const address = reinterpret_cast<word>(static_cast<void*>(object));
+                std::memcpy(image.bytes, &address, sizeof(word));
+                publish(vtable, image, true);
+                release_current();
+                current_ = {vtable, object};
+                current_on_heap_ = true;
+            }
+            reclaim();
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<detail::can_emplace<T, movable | copyable | allow_heap, std::decay_t<U>, U&&>()>>
+        void store(U&& value)
+        {
+            emplace<std::decay_t<U>>(std::forward<U>(value));
+        }
+
+        void reset() noexcept
+        {
+            publish(nullptr, snapshot{}, false);
+            release_current();
+            reclaim();
+        }
+
+        // Copy of the current value; can be called from any thread
+        [[nodiscard]] auto load() const -> value_type
+        {
+            auto result = value_type{this->allocator()};
+
+            for (;;)
+            {
+                auto image = snapshot{};
+                auto tagged_vtable = word{};
+                auto const sequence = read(image, tagged_vtable);
+                if (tagged_vtable == 0)
+                {
+                    return result;
+                }
+
+                auto const* const vtable = reinterpret_cast<vtable_type const*>(tagged_vtable & ~detail::heap_bit);
+                if ((tagged_vtable & detail::heap_bit) == 0)
+                {
+                    // A private copy of a bitwise copyable value
+                    vtable->load(image.bytes, result);
+                    return result;
+                }
+
+                // Register in the current epoch, then check that neither the epoch
+                // nor the value changed meanwhile; from then on, the object stays
+                // alive until the count drops.
+                auto const epoch = epoch_.load(std::memory_order_relaxed);
+                auto& readers = readers_[epoch % 2].count;
+                readers.fetch_add(1, std::memory_order_relaxed);
+                // Pairs with the fence in reclaim: either the writer sees this
+                // reader, or this reader sees the new epoch or value and retries
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (epoch_.load(std::memory_order_relaxed) != epoch || sequence_.load(std::memory_order_relaxed) != sequence)
+                {
+                    readers.fetch_sub(1, std::memory_order_release);
+                    continue;
+                }
+
+                try
+                {
+                    auto address = word{};
+                    std::memcpy(&address, image.bytes, sizeof(word));
+                    vtable->load(reinterpret_cast<void const*>(address), result);
+                }
+                catch (...)
+                {
+                    readers.fetch_sub(1, std::memory_order_release);
+                    throw;
+                }
+                readers.fetch_sub(1, std::memory_order_release);
+                return result;
+            }
+        }
+
+        // Frees the replaced heap values no reader can still be copying,
+        // and advances the epoch once the readers of the previous one are gone.
+        // Called by every store; only the writer may call it.
+        void reclaim() noexcept
+        {
+            // The second round frees the values retired in the current epoch,
+            // if it has no readers either
+            for (auto round = 0; round < 2 && !retired_.empty(); ++round)
+            {
+                // Pairs with the fence in load
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                auto const epoch = epoch_.load(std::memory_order_relaxed);
+                // Readers of earlier epochs were gone before the current one began
+                if (readers_[(epoch - 1) % 2].count.load(std::memory_order_acquire) != 0)
+                {
+                    return;
+                }
+
+                // Values retired before the current epoch were only visible to readers of earlier epochs
+                auto const last = std::find_if(retired_.begin(), retired_.end(), [&](retired const& r) {
+                    return r.epoch == epoch;
+                });
+                for (auto it = retired_.begin(); it != last; ++it)
+                {
+                    it->vtable->heap_delete(it->object, this->allocator());
+                }
+                retired_.erase(retired_.begin(), last);
+
+                // New readers now count where the previous epoch's readers did
+                epoch_.store(epoch + 1, std::memory_order_relaxed);
+            }
+        }
+
+        // Number of replaced heap values not freed yet
+        [[nodiscard]] auto retired_count() const noexcept -> std::size_t
+        {
+            return retired_.size();
+        }
+
+        [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+        {
+            return this->allocator();
+        }
+
+      private:
+        alignas(buffer_align) std::atomic<word> words_[word_count] = {};
+        // Tagged with heap_bit for heap values
+        std::atomic<word> vtable_ = 0;
+        // Odd while a store is in progress
+        std::atomic<std::uint64_t> sequence_ = 0;
+        // Starts at 1, so that no value is retired before the first epoch
+        std::atomic<std::uint64_t> epoch_ = 1;
+        mutable reader_count readers_[2];
+
+        // Writer side: the current value, and replaced heap values
+        retired current_ = {nullptr, nullptr};
+        bool current_on_heap_ = false;
+        snapshot current_object_;
+        // Its capacity always has room for retiring a current heap value
+        std::vector<retired, retired_alloc> retired_;
+
+        // Reads a consistent image of the published value and its tagged vtable,
+        // returns the sequence number it was published under
+        auto read(snapshot& image, word& tagged_vtable) const noexcept -> std::uint64_t
+        {
+            for (;;)
+            {
+                auto const sequence = sequence_.load(std::memory_order_acquire);
+                if (sequence % 2 != 0)
+                {
+                    continue;
+                }
+                tagged_vtable = vtable_.load(std::memory_order_relaxed);
+                for (auto i = std::size_t{}; i < word_count; ++i)
+                {
+                    auto const value = words_[i].load(std::memory_order_relaxed);
+                    std::memcpy(image.bytes + i * sizeof(word), &value, sizeof(word));
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == sequence)
+                {
+                    return sequence;
+                }
+            }
+        }
+
+        void publish(vtable_type const* const vtable, snapshot const& image, bool const is_on_heap) noexcept
+        {
+            auto const sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            vtable_.store(vtable ? detail::tag_vtable(vtable, is_on_heap) : 0, std::memory_order_relaxed);
+            for (auto i = std::size_t{}; i < word_count; ++i)
+            {
+                auto value = word{};
+                std::memcpy(&value, image.bytes + i * sizeof(word), sizeof(word));
+                words_[i].store(value, std::memory_order_relaxed);
+            }
+
+            sequence_.store(sequence + 2, std::memory_order_release);
+        }
+
+        // The current value is no longer published: in place values are
+        // destroyed, heap values wait for the readers
+        void release_current() noexcept
+        {
+            if (current_.vtable)
+            {
+                if (current_on_heap_)
+                {
+                    // Never allocates, the slot was reserved when the value was stored
+                    current_.epoch = epoch_.load(std::memory_order_relaxed);
+                    retired_.push_back(current_);
+                }
+                else
+                {
+                    current_.vtable->destroy(current_.object);
+                }
+            }
+            current_ = {nullptr, nullptr};
+            current_on_heap_ = false;
+        }
+
+        void free_retired() noexcept
+        {
+            for (auto const& r : retired_)
+            {
+                r.vtable->heap_delete(r.object, this->allocator());
+            }
+            retired_.clear();
+        }
+    };
+
+    namespace pmr
+    {
+        template <typename T, std::size_t sbo_size>
+        using seqlock_sbo_ptr = sboptr::seqlock_sbo_ptr<T, sbo_size, std::pmr::polymorphic_allocator<std::byte>>;
+    }  // namespace pmr
+}  // namespace sboptr
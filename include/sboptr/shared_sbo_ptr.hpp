@@ -0,0 +1,412 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "sboptr/sboptr.hpp"
+
+namespace sboptr
+{
+    namespace detail
+    {
+        // Reference count, vtable and small buffer in one allocation.
+        // Every block of a pointer type has the same size, so they suit the size-class pool.
+        template <typename Base, std::size_t sbo_size, std::size_t sbo_align, sbo_ptr_options opts, typename Allocator>
+        class shared_sbo_block : public sbo_ptr_allocator_storage<Allocator>
+        {
+          public:
+            // Shared objects never move, so the vtable of pinned pointers is enough
+            using vtable_type = sbo_ptr_vtable<Base, false, false, true, Allocator>;
+
+            static constexpr bool is_atomic = (opts & non_atomic) == 0;
+
+            explicit shared_sbo_block(Allocator const& alloc) noexcept
+              : sbo_ptr_allocator_storage<Allocator>{alloc}
+            {
+            }
+
+            shared_sbo_block(shared_sbo_block const&) = delete;
+            auto operator=(shared_sbo_block const&) = delete;
+
+            template <typename Derived, typename... Args>
+            [[nodiscard]] static auto create(Allocator const& alloc, Args&&... args) -> shared_sbo_block*
+            {
+                auto block_alloc = block_allocator{alloc};
+                auto* const block = new (block_traits::allocate(block_alloc, 1)) shared_sbo_block{alloc};
+                try
+                {
+                    block->template construct<Derived>(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    block->~shared_sbo_block();
+                    block_traits::deallocate(block_alloc, block, 1);
+                    throw;
+                }
+                return block;
+            }
+
+            void add_ref() noexcept
+            {
+                if constexpr (is_atomic)
+                {
+                    refs_.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    ++refs_;
+                }
+            }
+
+            // Destroys the object and frees the block with the last reference
+            void release() noexcept
+            {
+                if constexpr (is_atomic)
+                {
+                    if (refs_.fetch_sub(1, std::memory_order_release) != 1)
+                    {
+                        return;
+                    }
+                    // Writes through other references happen before the destruction
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                }
+                else if (--refs_ != 0)
+                {
+                    return;
+                }
+                destroy(this);
+            }
+
+            [[nodiscard]] auto use_count() const noexcept -> std::size_t
+            {
+                if constexpr (is_atomic)
+                {
+                    return refs_.load(std::memory_order_relaxed);
+                }
+                else
+                {
+                    return refs_;
+                }
+            }
+
+            [[nodiscard]] auto ptr() const noexcept -> Base*
+            {
+                return ptr_;
+            }
+
+            [[nodiscard]] auto on_heap() const noexcept -> bool
+            {
+                return (vtable_ & heap_bit) != 0;
+            }
+
+            template <typename Derived>
+            [[nodiscard]] auto holds() const noexcept -> bool
+            {
+                return reinterpret_cast<vtable_type const*>(vtable_ & ~heap_bit) == vtable_type::template get<Derived>();
+            }
+
+            [[nodiscard]] auto get_allocator() const noexcept -> Allocator
+            {
+                return this->allocator();
+            }
+
+          private:
+            using alloc_traits = sbo_ptr_alloc_traits<Allocator>;
+            using block_allocator = typename alloc_traits::template rebind_alloc<shared_sbo_block>;
+            using block_traits = std::allocator_traits<block_allocator>;
+
+            std::conditional_t<is_atomic, std::atomic<std::size_t>, std::size_t> refs_ = 1;
+            // Tagged with heap_bit for heap objects
+            std::uintptr_t vtable_ = 0;
+            Base* ptr_ = nullptr;
+            alignas(sbo_align) std::byte sbo_buffer_[sbo_size];
+
+            // Shared pointers always fall back to the heap, without the allow_heap option
+            static constexpr auto stats_opts = opts | allow_heap;
+
+            template <typename Derived, typename... Args>
+            void construct(Args&&... args)
+            {
+                if constexpr (fits_buffer<Derived, sbo_size, sbo_align>)
+                {
+                    ptr_ = alloc_traits::template construct<Derived>(this->allocator(), &sbo_buffer_, std::forward<Args>(args)...);
+                    vtable_ = tag_vtable(vtable_type::template get<Derived>(), false);
+                    count_construction<stats_opts, Derived>(false);
+                }
+                else
+                {
+                    ptr_ = alloc_traits::template heap_new<Derived>(this->allocator(), std::forward<Args>(args)...);
+                    vtable_ = tag_vtable(vtable_type::template get<Derived>(), true);
+                    count_construction<stats_opts, Derived>(true);
+                }
+            }
+
+            static void destroy(shared_sbo_block* const block) noexcept
+            {
+                auto const* const vtable = reinterpret_cast<vtable_type const*>(block->vtable_ & ~heap_bit);
+                if (block->on_heap())
+                {
+                    vtable->heap_delete(block->ptr_, block->allocator());
+                }
+                else
+                {
+                    destroy_in_place(vtable, block->ptr_);
+                }
+                auto block_alloc = block_allocator{block->allocator()};
+                block->~shared_sbo_block();
+                block_traits::deallocate(block_alloc, block, 1);
+            }
+        };
+    }  // namespace detail
+
+    // Shared ownership of a polymorphic object. The object is constructed
+    // in the small buffer of the reference-counted block, so a pointer costs
+    // a single allocation, and with the pooled option it comes from the
+    // size-class pool. Objects bigger than sbo_size, or over-aligned, get
+    // a separate heap allocation. Copies share the object and only increment
+    // the count, which is not atomic with the non_atomic option.
+    template <typename T, std::size_t sbo_size = sizeof(T), sbo_ptr_options opts = no_options, typename Allocator = default_allocator>
+    class shared_sbo_ptr
+    {
+      private:
+        static_assert(
+            (opts & ~(pooled | non_atomic | instrumented)) == 0,
+            "Shared pointers only support the pooled, non_atomic and instrumented options.");
+        static_assert(
+            !(opts & pooled) || detail::is_std_allocator<Allocator>::value,
+            "The pooled option provides its own allocator, it can not be combined with a custom one.");
+
+        static constexpr auto sbo_align = detail::default_sbo_alignment<T, sbo_size, opts>;
+
+      public:
+        using pointer = T*;
+        using element_type = T;
+        using allocator_type = detail::sbo_ptr_allocator_for_opts<opts, Allocator>;
+
+      private:
+        using block_type = detail::shared_sbo_block<T, sbo_size, sbo_align, opts, allocator_type>;
+
+        // Objects are never moved or copied
+        template <typename U, typename... Args>
+        static constexpr bool can_emplace = detail::can_emplace<T, allow_heap, U, Args...>();
+
+      public:
+        // Whether objects of type U are constructed in the block
+        template <typename U>
+        static constexpr bool stores_inline = detail::fits_buffer<U, sbo_size, sbo_align>;
+
+        shared_sbo_ptr() noexcept = default;
+
+        shared_sbo_ptr(std::nullptr_t) noexcept { }
+
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<can_emplace<U, Args&&...>>>
+        shared_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, std::in_place_type_t<U>, Args&&... args)
+          : shared_sbo_ptr{block_type::template create<U>(alloc, std::forward<Args>(args)...)}
+        {
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<
+                      !std::is_same_v<std::decay_t<U>, shared_sbo_ptr> && can_emplace<std::decay_t<U>, U&&>>>
+        shared_sbo_ptr(std::allocator_arg_t, allocator_type const& alloc, U&& value)
+          : shared_sbo_ptr{std::allocator_arg, alloc, std::in_place_type<std::decay_t<U>>, std::forward<U>(value)}
+        {
+        }
+
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<can_emplace<U, Args&&...>>>
+        explicit shared_sbo_ptr(std::in_place_type_t<U>, Args&&... args)
+          : shared_sbo_ptr{std::allocator_arg, allocator_type{}, std::in_place_type<U>, std::forward<Args>(args)...}
+        {
+        }
+
+        template <typename U,
+                  typename = std::enable_if_t<
+                      !std::is_same_v<std::decay_t<U>, shared_sbo_ptr> && can_emplace<std::decay_t<U>, U&&>>>
+        shared_sbo_ptr(U&& value)
+          : shared_sbo_ptr{std::in_place_type<std::decay_t<U>>, std::forward<U>(value)}
+        {
+        }
+
+        shared_sbo_ptr(shared_sbo_ptr const& other) noexcept
+          : block_{other.block_},
+            ptr_{other.ptr_}
+        {
+            if (block_)
+            {
+                block_->add_ref();
+            }
+        }
+
+        shared_sbo_ptr(shared_sbo_ptr&& other) noexcept
+          : block_{std::exchange(other.block_, nullptr)},
+            ptr_{std::exchange(other.ptr_, nullptr)}
+        {
+        }
+
+        auto operator=(shared_sbo_ptr const& other) noexcept -> shared_sbo_ptr&
+        {
+            shared_sbo_ptr{other}.swap(*this);
+            return *this;
+        }
+
+        auto operator=(shared_sbo_ptr&& other) noexcept -> shared_sbo_ptr&
+        {
+            shared_sbo_ptr{std::move(other)}.swap(*this);
+            return *this;
+        }
+
+        auto operator=(std::nullptr_t) noexcept -> shared_sbo_ptr&
+        {
+            reset();
+            return *this;
+        }
+
+        ~shared_sbo_ptr() noexcept
+        {
+            if (block_)
+            {
+                block_->release();
+            }
+        }
+
+        // The new object gets the allocator of the current one.
+        // Other references keep the old object.
+        template <typename U,
+                  typename... Args,
+                  typename = std::enable_if_t<can_emplace<U, Args&&...>>>
+        void emplace(Args&&... args)
+        {
+            auto const alloc = block_ ? block_->get_allocator() : allocator_type{};
+            shared_sbo_ptr{std::allocator_arg, alloc, std::in_place_type<U>, std::forward<Args>(args)...}.swap(*this);
+        }
+
+        void reset() noexcept
+        {
+            shared_sbo_ptr{}.swap(*this);
+        }
+
+        void swap(shared_sbo_ptr& other) noexcept
+        {
+            std::swap(block_, other.block_);
+            std::swap(ptr_, other.ptr_);
+        }
+
+        friend void swap(shared_sbo_ptr& lhs, shared_sbo_ptr& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+
+        // Number of pointers sharing the object, 0 if empty
+        [[nodiscard]] auto use_count() const noexcept -> std::size_t
+        {
+            return block_ ? block_->use_count() : 0;
+        }
+
+        [[nodiscard]] auto on_heap() const noexcept -> bool
+        {
+            return block_ && block_->on_heap();
+        }
+
+        [[nodiscard]] auto get() const noexcept -> T*
+        {
+            return ptr_;
+        }
+
+        // Whether the held object is exactly of type U, without RTTI
+        template <typename U>
+        [[nodiscard]] auto holds() const noexcept -> bool
+        {
+            static_assert(std::is_base_of_v<T, U>, "U must be derived from the pointer type.");
+            return block_ && block_->template holds<U>();
+        }
+
+        // The held object if it is exactly of type U, nullptr otherwise
+        template <typename U>
+        [[nodiscard]] auto get_if() const noexcept -> U*
+        {
+            return holds<U>() ? static_cast<U*>(get()) : nullptr;
+        }
+
+        [[nodiscard]] auto operator*() const noexcept -> T&
+        {
+            return *get();
+        }
+
+        [[nodiscard]] auto operator->() const noexcept -> T*
+        {
+            return get();
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return *this != nullptr;
+        }
+
+        [[nodiscard]] friend auto operator==(shared_sbo_ptr const& lhs, shared_sbo_ptr const& rhs) noexcept -> bool
+        {
+            return lhs.get() == rhs.get();
+        }
+
+        [[nodiscard]] friend auto operator==(shared_sbo_ptr const& lhs, std::nullptr_t) noexcept -> bool
+        {
+            return lhs.get() == nullptr;
+        }
+
+        [[nodiscard]] friend auto operator==(std::nullptr_t, shared_sbo_ptr const& rhs) noexcept -> bool
+        {
+            return rhs.get() == nullptr;
+        }
+
+        [[nodiscard]] friend auto operator!=(shared_sbo_ptr const& lhs, shared_sbo_ptr const& rhs) noexcept -> bool
+        {
+            return !(lhs == rhs);
+        }
+
+        [[nodiscard]] friend auto operator!=(shared_sbo_ptr const& lhs, std::nullptr_t) noexcept -> bool
+        {
+            return !(lhs == nullptr);
+        }
+
+        [[nodiscard]] friend auto operator!=(std::nullptr_t, shared_sbo_ptr const& rhs) noexcept -> bool
+        {
+            return !(nullptr == rhs);
+        }
+
+      private:
+        block_type* block_ = nullptr;
+        // Cached from the block, so dereferencing does not go through it
+        T* ptr_ = nullptr;
+
+        explicit shared_sbo_ptr(block_type* const block) noexcept
+          : block_{block},
+            ptr_{block->ptr()}
+        {
+        }
+    };
+
+    namespace detail
+    {
+        template <typename T, std::size_t sbo_size, sbo_ptr_options opts, typename Allocator>
+        struct is_sbo_ptr<shared_sbo_ptr<T, sbo_size, opts, Allocator>> : std::true_type
+        {
+        };
+    }  // namespace detail
+
+    template <typename T, std::size_t sbo_size = sizeof(T)>
+    using local_shared_sbo_ptr = shared_sbo_ptr<T, sbo_size, non_atomic>;
+
+    namespace pmr
+    {
+        template <typename T, std::size_t sbo_size = sizeof(T), sbo_ptr_options opts = no_options>
+        using shared_sbo_ptr = sboptr::shared_sbo_ptr<T, sbo_size, opts, std::pmr::polymorphic_allocator<std::byte>>;
+    }  // namespace pmr
+}  // namespace sboptr
@@ -0,0 +1,233 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "sboptr/algorithm.hpp"
+
+#include "fixtures.hpp"
+
+namespace {
+
+using namespace fixtures;
+
+// Copied with memcpy and never destroyed by the algorithms
+class rect final : public shape {
+  public:
+    static inline std::atomic<int> destructions = 0;
+
+    int width;
+    int height;
+
+    rect(int width, int height) : width{width}, height{height} {}
+    ~rect() override { ++destructions; }
+
+    auto area() const noexcept -> int override { return width * height; }
+};
+
+class throwing final : public shape {
+  public:
+    throwing() = default;
+    throwing(throwing const&) { throw std::runtime_error{"copy"}; }
+    throwing(throwing&&) noexcept = default;
+
+    auto area() const noexcept -> int override { return 0; }
+};
+
+using ptr = sboptr::sbo_ptr<shape, 16>;
+
+// Uninitialized storage for n pointers
+template <typename Ptr>
+class raw_array {
+  public:
+    explicit raw_array(std::size_t n) : storage_{std::make_unique<std::byte[]>(n * sizeof(Ptr))} {}
+
+    auto get() noexcept -> Ptr* { return std::launder(reinterpret_cast<Ptr*>(storage_.get())); }
+
+  private:
+    std::unique_ptr<std::byte[]> storage_;
+};
+
+// Assigns square, rect, big_square and empty, in runs of run_length
+template <typename Ptr>
+void fill(Ptr* const first, std::size_t const n, std::size_t const run_length)
+{
+    for (auto i = std::size_t{}; i < n; ++i) {
+        switch (i / run_length % 4) {
+        case 0: first[i] = square{static_cast<int>(i)}; break;
+        case 1: first[i] = rect{static_cast<int>(i), 2}; break;
+        case 2: first[i] = big_square{static_cast<int>(i)}; break;
+        default: first[i].reset(); break;
+        }
+    }
+}
+
+template <typename Ptr>
+void check(Ptr const* const first, std::size_t const n, std::size_t const run_length)
+{
+    for (auto i = std::size_t{}; i < n; ++i) {
+        auto const value = static_cast<int>(i);
+        switch (i / run_length % 4) {
+        case 0: REQUIRE(first[i]->area() == value * value); break;
+        case 1: REQUIRE(first[i]->area() == value * 2); break;
+        case 2: REQUIRE(first[i]->area() == value * value); break;
+        default: REQUIRE(!first[i]); break;
+        }
+    }
+}
+
+}  // namespace
+
+template <>
+struct sboptr::is_bitwise_copyable<rect> : std::true_type {};
+
+TEST_CASE("Range relocation") {
+    constexpr auto n = std::size_t{40};
+    auto from = raw_array<ptr>{n};
+    auto to = raw_array<ptr>{n};
+    std::uninitialized_default_construct_n(from.get(), n);
+    fill(from.get(), n, 3);
+    auto const squares = square::instances.load();
+    auto const big_squares = big_square::instances.load();
+    auto const* const heap_object = from.get()[6].get();
+
+    REQUIRE(sboptr::uninitialized_relocate_n(from.get(), n, to.get()) == to.get() + n);
+
+    check(to.get(), n, 3);
+    CHECK(square::instances == squares);
+    CHECK(big_square::instances == big_squares);
+    // Heap objects change owner without being moved
+    CHECK(to.get()[6].get() == heap_object);
+
+    sboptr::destroy_n(to.get(), n);
+    CHECK(square::instances == 0);
+    CHECK(big_square::instances == 0);
+}
+
+TEST_CASE("Range relocation of trivially relocatable pointers") {
+    using compact_ptr = sboptr::basic_sbo_ptr<shape, 16, sboptr::movable | sboptr::compact | sboptr::trivially_relocatable>;
+    static_assert(sboptr::is_trivially_relocatable_v<compact_ptr>);
+
+    constexpr auto n = std::size_t{8};
+    auto from = raw_array<compact_ptr>{n};
+    auto to = raw_array<compact_ptr>{n};
+    for (auto i = std::size_t{}; i < n; ++i) {
+        new (from.get() + i) compact_ptr{rect{static_cast<int>(i), 3}};
+    }
+
+    sboptr::uninitialized_relocate_n(from.get(), n, to.get());
+
+    for (auto i = std::size_t{}; i < n; ++i) {
+        CHECK(to.get()[i]->area() == static_cast<int>(i) * 3);
+    }
+    sboptr::destroy_n(to.get(), n);
+}
+
+TEST_CASE("Range copy") {
+    constexpr auto n = std::size_t{40};
+    auto from = std::vector<ptr>(n);
+    fill(from.data(), n, 5);
+    auto to = std::vector<ptr>(n);
+    to[0] = big_square{1};
+    to[7] = square{1};
+
+    REQUIRE(sboptr::copy_n(from.data(), n, to.data()) == to.data() + n);
+
+    check(to.data(), n, 5);
+    check(from.data(), n, 5);
+    // Heap objects are copied, not shared
+    CHECK(to[10].get() != from[10].get());
+
+    SECTION("Throwing copy leaves the destination empty") {
+        from[1] = throwing{};
+        CHECK_THROWS_AS(sboptr::copy_n(from.data(), n, to.data()), std::runtime_error);
+        CHECK(!to[1]);
+        CHECK(to[0]->area() == 0);
+    }
+}
+
+TEST_CASE("Range copy with allocators") {
+    auto resource = std::pmr::monotonic_buffer_resource{};
+    using pmr_ptr = sboptr::pmr::sbo_ptr<shape, 16>;
+
+    auto from = std::pmr::vector<pmr_ptr>{&resource};
+    from.emplace_back(square{2});
+    from.emplace_back(big_square{3});
+    auto to = std::pmr::vector<pmr_ptr>(2, &resource);
+
+    sboptr::copy_n(from.data(), from.size(), to.data());
+
+    CHECK(to[0]->area() == 4);
+    CHECK(to[1]->area() == 9);
+    CHECK(to[1].get_allocator().resource() == &resource);
+}
+
+TEST_CASE("Range destruction") {
+    constexpr auto n = std::size_t{12};
+    auto storage = raw_array<ptr>{n};
+    std::uninitialized_default_construct_n(storage.get(), n);
+    fill(storage.get(), n, 1);
+    auto const destructions = rect::destructions.load();
+
+    REQUIRE(sboptr::destroy_n(storage.get(), n) == storage.get() + n);
+
+    CHECK(square::instances == 0);
+    CHECK(big_square::instances == 0);
+    // Bitwise copyable objects are not destroyed
+    CHECK(rect::destructions == destructions);
+}
+
+TEST_CASE("Parallel range algorithms") {
+    constexpr auto n = std::size_t{1000};
+    constexpr auto policy = sboptr::parallel_policy{4, 16};
+
+    auto from = raw_array<ptr>{n};
+    auto to = raw_array<ptr>{n};
+    std::uninitialized_default_construct_n(from.get(), n);
+    fill(from.get(), n, 7);
+
+    sboptr::uninitialized_relocate_n(policy, from.get(), n, to.get());
+    check(to.get(), n, 7);
+
+    auto copies = std::vector<ptr>(n);
+    sboptr::copy_n(policy, static_cast<ptr const*>(to.get()), n, copies.data());
+    check(copies.data(), n, 7);
+
+    sboptr::destroy_n(policy, to.get(), n);
+    copies.clear();
+    CHECK(square::instances == 0);
+    CHECK(big_square::instances == 0);
+
+    SECTION("Copies are charged to the budget of the caller") {
+        using budgeted_ptr = sboptr::basic_sbo_ptr<shape, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::budgeted>;
+        auto sources = std::vector<budgeted_ptr>{};
+        for (auto i = std::size_t{}; i < n; ++i) {
+            sources.emplace_back(big_square{static_cast<int>(i)});
+        }
+
+        auto const global_used = sboptr::heap_budget::global().used();
+        auto budget = sboptr::heap_budget{};
+        auto targets = std::vector<budgeted_ptr>(n);
+        {
+            auto const scope = sboptr::heap_budget_scope{budget};
+            sboptr::copy_n(policy, static_cast<budgeted_ptr const*>(sources.data()), n, targets.data());
+        }
+        CHECK(budget.used() == n * sizeof(big_square));
+        CHECK(sboptr::heap_budget::global().used() == global_used);
+
+        targets.clear();
+        CHECK(budget.used() == 0);
+    }
+
+    SECTION("Exceptions are passed to the caller") {
+        auto sources = std::vector<ptr>(n);
+        sources[n - 1] = throwing{};
+        auto targets = std::vector<ptr>(n);
+        CHECK_THROWS_AS(sboptr::copy_n(policy, sources.data(), n, targets.data()), std::runtime_error);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Types shared by the tests of the containers and algorithms
+namespace fixtures {
+
+/** Counts the live objects of Derived, including copies and moves */
+template <typename Derived>
+class counted {
+  public:
+    static inline std::atomic<int> instances = 0;
+
+    counted() noexcept { ++instances; }
+    counted(counted const&) noexcept { ++instances; }
+    counted(counted&&) noexcept { ++instances; }
+    ~counted() { --instances; }
+
+    auto operator=(counted const&) noexcept -> counted& = default;
+    auto operator=(counted&&) noexcept -> counted& = default;
+};
+
+class shape {
+  public:
+    virtual ~shape() = default;
+
+    [[nodiscard]] virtual auto area() const noexcept -> int = 0;
+};
+
+class square : public shape, public counted<square> {
+  public:
+    int side;
+
+    explicit square(int side) : side{side} {}
+
+    auto area() const noexcept -> int override { return side * side; }
+};
+
+// Does not fit in the small buffers of the tests
+class big_square final : public shape, public counted<big_square> {
+  public:
+    std::array<int, 32> sides = {};
+
+    explicit big_square(int side) { sides.fill(side); }
+
+    auto area() const noexcept -> int override { return sides[0] * sides[0]; }
+};
+
+// Derive from this and the base to get the base at a non-zero offset,
+// in an object that is not trivially relocatable
+class other_base {
+  public:
+    virtual ~other_base() = default;
+
+    int tag = 10;
+};
+
+}  // namespace fixtures
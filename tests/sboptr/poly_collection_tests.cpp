@@ -0,0 +1,169 @@
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "sboptr/poly_collection.hpp"
+
+#include "fixtures.hpp"
+
+namespace {
+
+using namespace fixtures;
+
+class entity {
+  public:
+    virtual ~entity() = default;
+
+    [[nodiscard]] virtual auto id() const noexcept -> int = 0;
+    virtual void update() noexcept = 0;
+};
+
+class particle final : public entity, public counted<particle> {
+  public:
+    int value;
+    int updates = 0;
+
+    explicit particle(int value) : value{value} {}
+
+    auto id() const noexcept -> int override { return value; }
+    void update() noexcept override { ++updates; }
+};
+
+class named final : public other_base, public entity {
+  public:
+    std::string name;
+    int value;
+
+    named(std::string name, int value) : name{std::move(name)}, value{value} {}
+
+    auto id() const noexcept -> int override { return value; }
+    void update() noexcept override { name += '!'; }
+};
+
+class throwing final : public entity {
+  public:
+    explicit throwing(int) { throw std::runtime_error{"throwing"}; }
+
+    auto id() const noexcept -> int override { return -1; }
+    void update() noexcept override {}
+};
+
+template <typename Collection>
+auto ids(Collection const& collection) -> std::vector<int> {
+    auto result = std::vector<int>{};
+    collection.for_each([&](entity const& e) { result.push_back(e.id()); });
+    return result;
+}
+
+}  // namespace
+
+TEST_CASE("poly_collection") {
+    particle::instances = 0;
+
+    SECTION("Objects are grouped by type") {
+        auto collection = sboptr::poly_collection<entity>{};
+        CHECK(collection.empty());
+
+        for (auto i = 0; i < 20; ++i) {
+            if (i % 2 == 0) {
+                collection.emplace<particle>(i);
+            } else {
+                collection.emplace<named>(std::string(32, 'x'), i);
+            }
+        }
+        auto& p = collection.insert(particle{100});
+        CHECK(p.value == 100);
+
+        CHECK(collection.size() == 21);
+        CHECK(collection.size<particle>() == 11);
+        CHECK(collection.size<named>() == 10);
+        CHECK(collection.segment_count() == 2);
+        CHECK(particle::instances == 11);
+        CHECK(ids(collection) == std::vector<int>{0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 100, 1, 3, 5, 7, 9, 11, 13, 15, 17, 19});
+
+        collection.clear();
+        CHECK(collection.empty());
+        CHECK(particle::instances == 0);
+    }
+
+    SECTION("Listed types are visited statically") {
+        auto collection = sboptr::poly_collection<entity>{};
+        collection.emplace<particle>(1);
+        collection.emplace<named>("a", 2);
+        collection.emplace<particle>(3);
+
+        auto static_visits = 0;
+        auto dynamic_visits = 0;
+        auto const visitor = [&](auto& e) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(e)>, particle>) {
+                ++static_visits;
+            } else {
+                ++dynamic_visits;
+            }
+            e.update();
+        };
+        collection.for_each<particle>(visitor);
+        CHECK(static_visits == 2);
+        CHECK(dynamic_visits == 1);
+
+        auto updates = 0;
+        auto names = std::string{};
+        std::as_const(collection).for_each<particle, named>([&](auto const& e) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(e)>, particle>) {
+                updates += e.updates;
+            } else if constexpr (std::is_same_v<std::decay_t<decltype(e)>, named>) {
+                names += e.name;
+            } else {
+                FAIL("All types are listed");
+            }
+        });
+        CHECK(updates == 2);
+        CHECK(names == "a!");
+    }
+
+    SECTION("Throwing emplace leaves the collection unchanged") {
+        auto collection = sboptr::poly_collection<entity>{};
+        collection.reserve<particle>(2);
+        collection.emplace<particle>(1);
+        collection.emplace<particle>(2);
+        CHECK_THROWS_AS(collection.emplace<throwing>(0), std::runtime_error);
+        CHECK(ids(collection) == std::vector<int>{1, 2});
+    }
+
+    SECTION("Move") {
+        auto collection = sboptr::poly_collection<entity>{};
+        collection.emplace<particle>(1);
+        collection.emplace<named>("a", 2);
+
+        auto moved = std::move(collection);
+        CHECK(collection.empty());
+        CHECK(ids(moved) == std::vector<int>{1, 2});
+
+        collection = std::move(moved);
+        CHECK(ids(collection) == std::vector<int>{1, 2});
+    }
+
+    SECTION("Polymorphic allocator") {
+        // Everything must come from the buffer, the upstream resource throws
+        auto buffer = std::array<std::byte, 4096>{};
+        auto resource = std::pmr::monotonic_buffer_resource{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+
+        auto collection = sboptr::pmr::poly_collection<entity>{&resource};
+        collection.emplace<particle>(1);
+        collection.emplace<named>("a", 2);
+        CHECK(collection.get_allocator().resource() == &resource);
+
+        // Different resource, so the segments are moved one by one
+        auto other = sboptr::pmr::poly_collection<entity>{};
+        other = std::move(collection);
+        CHECK(collection.empty());
+        CHECK(other.get_allocator().resource() == std::pmr::get_default_resource());
+        CHECK(ids(other) == std::vector<int>{1, 2});
+    }
+
+    CHECK(particle::instances == 0);
+}
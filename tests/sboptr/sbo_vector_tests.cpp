@@ -0,0 +1,175 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "sboptr/sbo_vector.hpp"
+
+#include "fixtures.hpp"
+
+namespace {
+
+using namespace fixtures;
+
+class named_rect : public other_base, public shape {
+  public:
+    std::string label;
+    int width;
+    int height;
+
+    named_rect(std::string label, int width, int height)
+        : label{std::move(label)}, width{width}, height{height} {}
+
+    auto area() const noexcept -> int override { return width * height; }
+};
+
+class throwing_shape : public shape {
+  public:
+    explicit throwing_shape(int) { throw std::runtime_error{"throwing_shape"}; }
+
+    auto area() const noexcept -> int override { return 0; }
+};
+
+constexpr auto slot_size = sizeof(named_rect);
+
+template <typename Vector>
+auto areas(Vector const& vector) -> std::vector<int> {
+    auto result = std::vector<int>{};
+    vector.for_each([&](shape const& s) { result.push_back(s.area()); });
+    return result;
+}
+
+}  // namespace
+
+TEST_CASE("sbo_vector") {
+    square::instances = 0;
+
+    SECTION("Emplace and iterate") {
+        auto vector = sboptr::sbo_vector<shape, slot_size>{};
+        CHECK(vector.empty());
+
+        auto& sq = vector.emplace_back<square>(2);
+        CHECK(sq.side == 2);
+        vector.emplace_back<named_rect>("rect", 2, 3);
+        vector.emplace_back<big_square>(7);
+        vector.push_back(square{3});
+
+        REQUIRE(vector.size() == 4);
+        CHECK(areas(vector) == std::vector<int>{4, 6, 49, 9});
+        CHECK(vector.front().area() == 4);
+        CHECK(vector.back().area() == 9);
+        CHECK(dynamic_cast<named_rect const&>(vector[1]).tag == 10);
+        CHECK(dynamic_cast<named_rect const&>(vector[1]).label == "rect");
+
+        auto sum = 0;
+        for (auto const& s : vector) {
+            sum += s.area();
+        }
+        CHECK(sum == 68);
+
+        vector.pop_back();
+        CHECK(vector.size() == 3);
+        CHECK(square::instances == 1);
+        vector.clear();
+        CHECK(vector.empty());
+        CHECK(square::instances == 0);
+    }
+
+    SECTION("Growth keeps the objects") {
+        auto vector = sboptr::sbo_vector<shape, slot_size>{};
+        for (auto i = 0; i < 100; ++i) {
+            if (i % 3 == 0) {
+                vector.emplace_back<named_rect>(std::string(32, 'x'), i, 1);
+            } else if (i % 3 == 1) {
+                vector.emplace_back<big_square>(i);
+            } else {
+                vector.emplace_back<square>(i);
+            }
+        }
+        REQUIRE(vector.size() == 100);
+        CHECK(vector.capacity() >= 100);
+        for (auto i = 0; i < 100; ++i) {
+            CHECK(vector[static_cast<std::size_t>(i)].area() == (i % 3 == 0 ? i : i * i));
+        }
+        CHECK(dynamic_cast<named_rect const&>(vector[99]).label == std::string(32, 'x'));
+    }
+
+    SECTION("Throwing emplace leaves the vector unchanged") {
+        auto vector = sboptr::sbo_vector<shape, slot_size>{};
+        vector.emplace_back<square>(1);
+        REQUIRE(vector.capacity() == vector.size() + 3);
+        vector.emplace_back<square>(2);
+        vector.emplace_back<square>(3);
+        vector.emplace_back<square>(4);
+        CHECK_THROWS_AS(vector.emplace_back<throwing_shape>(0), std::runtime_error);
+        CHECK(areas(vector) == std::vector<int>{1, 4, 9, 16});
+    }
+
+    SECTION("Copy and move") {
+        auto vector = sboptr::sbo_vector<shape, slot_size, sboptr::movable | sboptr::copyable | sboptr::allow_heap>{};
+        vector.emplace_back<square>(2);
+        vector.emplace_back<named_rect>("rect", 2, 3);
+        vector.emplace_back<big_square>(7);
+
+        auto copy = vector;
+        CHECK(areas(copy) == areas(vector));
+        CHECK(&copy[2] != &vector[2]);
+
+        auto moved = std::move(vector);
+        CHECK(vector.empty());
+        CHECK(areas(moved) == areas(copy));
+
+        vector = copy;
+        CHECK(areas(vector) == areas(copy));
+        copy = std::move(moved);
+        CHECK(areas(copy) == areas(vector));
+    }
+
+    SECTION("No heap fallback") {
+        using vector_t = sboptr::sbo_vector<shape, slot_size, sboptr::movable>;
+        static_assert(!std::is_copy_constructible_v<vector_t>);
+        static_assert(std::is_nothrow_move_constructible_v<vector_t>);
+
+        auto vector = vector_t{};
+        vector.emplace_back<square>(5);
+        vector.emplace_back<named_rect>("rect", 1, 2);
+        CHECK(areas(vector) == std::vector<int>{25, 2});
+    }
+
+    SECTION("Over-aligned objects go to the heap") {
+        struct alignas(64) aligned_square : square {
+            using square::square;
+        };
+
+        auto vector = sboptr::sbo_vector<shape, sizeof(aligned_square)>{};
+        vector.emplace_back<aligned_square>(3);
+        vector.emplace_back<square>(2);
+        CHECK(reinterpret_cast<std::uintptr_t>(&vector[0]) % 64 == 0);
+        CHECK(areas(vector) == std::vector<int>{9, 4});
+    }
+
+    SECTION("Polymorphic allocator") {
+        // Everything must come from the buffer, the upstream resource throws
+        auto buffer = std::array<std::byte, 4096>{};
+        auto resource = std::pmr::monotonic_buffer_resource{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+
+        auto vector = sboptr::pmr::sbo_vector<shape, slot_size>{&resource};
+        vector.emplace_back<big_square>(1);
+        vector.emplace_back<square>(2);
+        CHECK(vector.get_allocator().resource() == &resource);
+
+        // Different resource, so the elements are moved one by one
+        auto other = sboptr::pmr::sbo_vector<shape, slot_size>{
+            std::allocator_arg, std::pmr::new_delete_resource(), std::move(vector)};
+        CHECK(vector.empty());
+        CHECK(other.get_allocator().resource() == std::pmr::new_delete_resource());
+        CHECK(areas(other) == std::vector<int>{1, 4});
+    }
+
+    CHECK(square::instances == 0);
+    CHECK(big_square::instances == 0);
+}
@@ -1,10 +1,25 @@
 #include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <catch2/catch.hpp>
+
+// Precondition violations are counted instead of aborting, so that they can be tested
+inline auto assertion_failures = 0;
+#define SBOPTR_ASSERT(condition) static_cast<void>((condition) || (++assertion_failures, false))
+
 #include "sboptr/sboptr.hpp"
 
 namespace {
@@ -123,54 +138,255 @@ class interface_copy_throw_impl : public interface, public new_base<interface_co
     auto foo() const noexcept -> int override { return foo_constant; }
 };
 
+class counting_resource : public std::pmr::memory_resource {
+  public:
+    std::size_t allocations = 0;
+    std::size_t deallocations = 0;
+    std::size_t bytes_in_use = 0;
+
+  private:
+    auto do_allocate(std::size_t const bytes, std::size_t const alignment) -> void* override {
+        ++allocations;
+        bytes_in_use += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* const ptr, std::size_t const bytes, std::size_t const alignment) override {
+        ++deallocations;
+        bytes_in_use -= bytes;
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    [[nodiscard]] auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override {
+        return this == &other;
+    }
+};
+
+class interface_pmr_impl : public interface {
+  public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    static constexpr auto foo_constant = 4;
+
+    std::pmr::string str;
+
+    explicit interface_pmr_impl(std::string_view const str, allocator_type const& alloc = {})
+        : str{str, alloc} {}
+
+    interface_pmr_impl(interface_pmr_impl const& other, allocator_type const& alloc = {})
+        : str{other.str, alloc} {}
+
+    interface_pmr_impl(interface_pmr_impl&& other) noexcept = default;
+
+    interface_pmr_impl(interface_pmr_impl&& other, allocator_type const& alloc)
+        : str{std::move(other.str), alloc} {}
+
+    auto foo() const noexcept -> int override { return foo_constant; }
+};
+
+class interface_relocatable_impl : public interface {
+  public:
+    static constexpr auto foo_constant = 6;
+    static inline auto move_count = 0;
+
+    int value;
+
+    explicit interface_relocatable_impl(int const value) noexcept : value{value} {}
+
+    interface_relocatable_impl(interface_relocatable_impl const&) = default;
+
+    interface_relocatable_impl(interface_relocatable_impl&& other) noexcept : value{other.value} {
+        ++move_count;
+    }
+
+    auto foo() const noexcept -> int override { return foo_constant; }
+};
+
+template <std::size_t size>
+class interface_big_impl : public interface {
+  public:
+    static constexpr auto foo_constant = 5;
+
+    std::array<char, size> data = {};
+
+    auto foo() const noexcept -> int override { return foo_constant; }
+};
+
+// Counts constructions and assignments
+class counted_impl : public interface {
+  public:
+    static inline auto constructions = 0;
+    static inline auto assignments = 0;
+
+    std::array<char, 64> data = {};
+
+    counted_impl() { ++constructions; }
+    counted_impl(counted_impl const& other) : data{other.data} { ++constructions; }
+    counted_impl(counted_impl&& other) noexcept : data{other.data} { ++constructions; }
+    auto operator=(counted_impl const& other) -> counted_impl& {
+        data = other.data;
+        ++assignments;
+        return *this;
+    }
+    auto operator=(counted_impl&& other) noexcept -> counted_impl& {
+        data = other.data;
+        ++assignments;
+        return *this;
+    }
+
+    auto foo() const noexcept -> int override { return data[0]; }
+};
+
+// No virtual destructor: objects are destroyed through the pointer's vtable
+class plain_interface {
+  public:
+    [[nodiscard]] virtual auto foo() const noexcept -> int = 0;
+};
+
+inline auto plain_instances = 0;
+
+template <std::size_t size>
+class plain_impl final : public plain_interface {
+  public:
+    std::array<char, size> data = {};
+
+    plain_impl() { ++plain_instances; }
+    plain_impl(plain_impl const& other) : data{other.data} { ++plain_instances; }
+    plain_impl(plain_impl&& other) noexcept : data{other.data} { ++plain_instances; }
+    ~plain_impl() { --plain_instances; }
+
+    auto foo() const noexcept -> int override { return static_cast<int>(size); }
+};
+
+// Without a virtual destructor, even polymorphic types can be trivially destructible
+class trivial_impl final : public plain_interface {
+  public:
+    auto foo() const noexcept -> int override { return 0; }
+};
+
+// External polymorphism: unrelated types without a vptr, used through shape_ops
+struct ext_square {
+    int side;
+};
+
+struct ext_rect {
+    int width;
+    int height;
+};
+
+inline auto ext_instances = 0;
+
+struct ext_polygon {
+    std::array<int, 16> sides = {};
+
+    explicit ext_polygon(int side) { sides.fill(side); ++ext_instances; }
+    ext_polygon(ext_polygon const& other) : sides{other.sides} { ++ext_instances; }
+    ext_polygon(ext_polygon&& other) noexcept : sides{other.sides} { ++ext_instances; }
+    ~ext_polygon() { --ext_instances; }
+};
+
+auto area(ext_square const& s) noexcept -> int { return s.side * s.side; }
+auto area(ext_rect const& r) noexcept -> int { return r.width * r.height; }
+auto area(ext_polygon const& p) noexcept -> int { return p.sides[0] * 16; }
+
+void scale(ext_square& s, int factor) noexcept { s.side *= factor; }
+void scale(ext_rect& r, int factor) noexcept { r.width *= factor; r.height *= factor; }
+void scale(ext_polygon& p, int factor) noexcept { for (auto& side : p.sides) { side *= factor; } }
+
+struct shape_ops {
+    int (*area)(void const*) noexcept;
+    void (*scale)(void*, int) noexcept;
+
+    template <typename Derived>
+    static constexpr auto create() noexcept -> shape_ops {
+        return {
+            [](void const* object) noexcept { return ::area(*static_cast<Derived const*>(object)); },
+            [](void* object, int factor) noexcept { ::scale(*static_cast<Derived*>(object), factor); },
+        };
+    }
+};
+
+using ext_shape = sboptr::external<shape_ops>;
+
+// Operations added to pointers of a non-polymorphic base
+struct record {};
+
+struct point_record : record {
+    int x;
+    int y;
+
+    point_record(int x, int y) : x{x}, y{y} {}
+};
+
+struct name_record : record {
+    std::string name;
+
+    explicit name_record(std::string name) : name{std::move(name)} {}
+};
+
 template <typename TupleA, typename TupleB>
 using tuple_cat_t = decltype(std::tuple_cat(std::declval<TupleA>(), std::declval<TupleB>()));
 template <typename Elem, typename Tuple>
 using tuple_append_t = tuple_cat_t<Tuple, std::tuple<Elem>>;
 
-using no_alloc_copy_ptrs_small = std::tuple<sboptr::no_alloc_sbo_ptr<interface>>;
-using no_alloc_move_ptrs_small = tuple_append_t<
-    sboptr::unique_no_alloc_sbo_ptr<interface>,
+template <std::size_t sbo_size, sboptr::sbo_ptr_options opts>
+using compact_ptr = sboptr::basic_sbo_ptr<interface, sbo_size, opts | sboptr::compact>;
+
+using no_alloc_copy_ptrs_small = std::tuple<
+    sboptr::no_alloc_sbo_ptr<interface>,
+    compact_ptr<sizeof(interface), sboptr::movable | sboptr::copyable>>;
+using no_alloc_move_ptrs_small = tuple_cat_t<
+    std::tuple<sboptr::unique_no_alloc_sbo_ptr<interface>, compact_ptr<sizeof(interface), sboptr::movable>>,
     no_alloc_copy_ptrs_small>;
 using no_alloc_ptrs_small = tuple_append_t<
     sboptr::pinned_no_alloc_sbo_ptr<interface>,
     no_alloc_move_ptrs_small>;
 
-using alloc_copy_ptrs_small = std::tuple<sboptr::sbo_ptr<interface>>;
-using alloc_move_ptrs_small = tuple_append_t<
-    sboptr::unique_sbo_ptr<interface>,
+using alloc_copy_ptrs_small = std::tuple<
+    sboptr::sbo_ptr<interface>,
+    compact_ptr<sizeof(interface), sboptr::movable | sboptr::copyable | sboptr::allow_heap>>;
+using alloc_move_ptrs_small = tuple_cat_t<
+    std::tuple<sboptr::unique_sbo_ptr<interface>, compact_ptr<sizeof(interface), sboptr::movable | sboptr::allow_heap>>,
     alloc_copy_ptrs_small>;
 using alloc_ptrs_small = tuple_append_t<
     sboptr::pinned_sbo_ptr<interface>,
     alloc_move_ptrs_small>;
 
-using no_alloc_copy_ptrs_medium = std::tuple<sboptr::no_alloc_sbo_ptr<interface, sizeof(interface_impl_a)>>;
-using no_alloc_move_ptrs_medium = tuple_append_t<
-    sboptr::unique_no_alloc_sbo_ptr<interface, sizeof(interface_impl_a)>,
+using no_alloc_copy_ptrs_medium = std::tuple<
+    sboptr::no_alloc_sbo_ptr<interface, sizeof(interface_impl_a)>,
+    compact_ptr<sizeof(interface_impl_a), sboptr::movable | sboptr::copyable>>;
+using no_alloc_move_ptrs_medium = tuple_cat_t<
+    std::tuple<sboptr::unique_no_alloc_sbo_ptr<interface, sizeof(interface_impl_a)>, compact_ptr<sizeof(interface_impl_a), sboptr::movable>>,
     no_alloc_copy_ptrs_medium>;
 using no_alloc_ptrs_medium = tuple_append_t<
     sboptr::pinned_no_alloc_sbo_ptr<interface, sizeof(interface_impl_a)>,
     no_alloc_move_ptrs_medium>;
 
-using alloc_copy_ptrs_medium = std::tuple<sboptr::sbo_ptr<interface, sizeof(interface_impl_a)>>;
-using alloc_move_ptrs_medium = tuple_append_t<
-    sboptr::unique_sbo_ptr<interface, sizeof(interface_impl_a)>,
+using alloc_copy_ptrs_medium = std::tuple<
+    sboptr::sbo_ptr<interface, sizeof(interface_impl_a)>,
+    compact_ptr<sizeof(interface_impl_a), sboptr::movable | sboptr::copyable | sboptr::allow_heap>>;
+using alloc_move_ptrs_medium = tuple_cat_t<
+    std::tuple<sboptr::unique_sbo_ptr<interface, sizeof(interface_impl_a)>, compact_ptr<sizeof(interface_impl_a), sboptr::movable | sboptr::allow_heap>>,
     alloc_copy_ptrs_medium>;
 using alloc_ptrs_medium = tuple_append_t<
     sboptr::pinned_sbo_ptr<interface, sizeof(interface_impl_a)>,
     alloc_move_ptrs_medium>;
 
-using no_alloc_copy_ptrs_big = std::tuple<sboptr::no_alloc_sbo_ptr<interface, sizeof(interface_impl_b)>>;
-using no_alloc_move_ptrs_big = tuple_append_t<
-    sboptr::unique_no_alloc_sbo_ptr<interface, sizeof(interface_impl_b)>,
+using no_alloc_copy_ptrs_big = std::tuple<
+    sboptr::no_alloc_sbo_ptr<interface, sizeof(interface_impl_b)>,
+    compact_ptr<sizeof(interface_impl_b), sboptr::movable | sboptr::copyable>>;
+using no_alloc_move_ptrs_big = tuple_cat_t<
+    std::tuple<sboptr::unique_no_alloc_sbo_ptr<interface, sizeof(interface_impl_b)>, compact_ptr<sizeof(interface_impl_b), sboptr::movable>>,
     no_alloc_copy_ptrs_big>;
 using no_alloc_ptrs_big = tuple_append_t<
     sboptr::pinned_no_alloc_sbo_ptr<interface, sizeof(interface_impl_b)>,
     no_alloc_move_ptrs_big>;
 
-using alloc_copy_ptrs_big = std::tuple<sboptr::sbo_ptr<interface, sizeof(interface_impl_b)>>;
-using alloc_move_ptrs_big = tuple_append_t<
-    sboptr::unique_sbo_ptr<interface, sizeof(interface_impl_b)>,
+using alloc_copy_ptrs_big = std::tuple<
+    sboptr::sbo_ptr<interface, sizeof(interface_impl_b)>,
+    compact_ptr<sizeof(interface_impl_b), sboptr::movable | sboptr::copyable | sboptr::allow_heap>>;
+using alloc_move_ptrs_big = tuple_cat_t<
+    std::tuple<sboptr::unique_sbo_ptr<interface, sizeof(interface_impl_b)>, compact_ptr<sizeof(interface_impl_b), sboptr::movable | sboptr::allow_heap>>,
     alloc_copy_ptrs_big>;
 using alloc_ptrs_big = tuple_append_t<
     sboptr::pinned_sbo_ptr<interface, sizeof(interface_impl_b)>,
@@ -261,6 +477,28 @@ auto const impl_b = interface_impl_b{long_string, long_string_2};
 
 }
 
+template <>
+struct sboptr::is_trivially_relocatable<interface_relocatable_impl> : std::true_type {};
+
+template <>
+struct sboptr::sbo_ptr_operations<record> {
+    auto (*serialize)(record const&) -> std::string;
+
+    template <typename Derived>
+    static constexpr auto create() noexcept -> sbo_ptr_operations {
+        return {
+            [](record const& r) -> std::string {
+                auto const& derived = static_cast<Derived const&>(r);
+                if constexpr (std::is_same_v<Derived, point_record>) {
+                    return std::to_string(derived.x) + "," + std::to_string(derived.y);
+                } else {
+                    return derived.name;
+                }
+            },
+        };
+    }
+};
+
 TEST_CASE("Empty pointer") {
     auto default_inited_ptrs = ptrs_small{};
 
@@ -292,6 +530,81 @@ TEST_CASE("Empty pointer") {
     }
 }
 
+#if defined(__cpp_constinit)
+namespace {
+
+// Tables without a dynamic initializer, filled on first use
+constinit sboptr::no_alloc_sbo_ptr<plain_interface, 16> strategy_table[2];
+constinit sboptr::pinned_sbo_ptr<plain_interface, 16> pinned_table[2] = {nullptr, nullptr};
+constinit sboptr::basic_sbo_ptr<plain_interface, 16, sboptr::movable | sboptr::allow_heap | sboptr::compact> compact_table[2];
+
+class constant_strategy final : public plain_interface {
+  public:
+    int value;
+
+    constexpr explicit constant_strategy(int value) : value{value} {}
+
+    auto foo() const noexcept -> int override { return value; }
+};
+
+class sum_strategy final : public plain_interface {
+  public:
+    std::array<int, 4> terms;
+
+    constexpr sum_strategy(int a, int b) : terms{a, b} {}
+
+    auto foo() const noexcept -> int override { return terms[0] + terms[1] + terms[2] + terms[3]; }
+};
+
+using constant_strategy_ptr = sboptr::no_alloc_sbo_ptr_for<plain_interface, constant_strategy, sum_strategy>;
+using constant_pinned_ptr = sboptr::pinned_sbo_ptr_for<plain_interface, sum_strategy>;
+
+// Objects of the listed types are constructed at compile time
+constinit constant_strategy_ptr populated_table[3] = {
+    constant_strategy_ptr{std::in_place_type<sum_strategy>, 2, 3},
+    constant_strategy_ptr{constant_strategy{7}},
+    nullptr,
+};
+constinit constant_pinned_ptr populated_pinned{std::in_place_type<sum_strategy>, 1, 1};
+
+}  // namespace
+
+TEST_CASE("Constant initialization") {
+    CHECK(!strategy_table[0]);
+    CHECK(!pinned_table[1]);
+    CHECK(!compact_table[0]);
+
+    strategy_table[0] = plain_impl<4>{};
+    pinned_table[1].emplace<plain_impl<64>>();
+    compact_table[0] = trivial_impl{};
+    CHECK(strategy_table[0]->foo() == 4);
+    CHECK(pinned_table[1]->foo() == 64);
+    CHECK(compact_table[0]->foo() == 0);
+
+    strategy_table[0].reset();
+    pinned_table[1].reset();
+}
+
+TEST_CASE("Constant initialization of objects") {
+    CHECK(populated_table[0]->foo() == 5);
+    CHECK(populated_table[0].holds<sum_strategy>());
+    CHECK(populated_table[1].get_if<constant_strategy>()->value == 7);
+    CHECK(!populated_table[2]);
+    CHECK(populated_pinned->foo() == 2);
+
+    // The objects are used like those constructed at run time
+    auto const copy = populated_table[0];
+    CHECK(copy->foo() == 5);
+    populated_table[2] = std::move(populated_table[1]);
+    CHECK(!populated_table[1]);
+    CHECK(populated_table[2]->foo() == 7);
+    populated_table[0].emplace<constant_strategy>(3);
+    CHECK(populated_table[0]->foo() == 3);
+    populated_table[0] = sum_strategy{4, 4};
+    CHECK(populated_table[0]->foo() == 8);
+}
+#endif
+
 TEST_CASE("Constructing objects in small buffer") {
     SECTION("Move construction from impls") {
         tuple_for_each(ptrs_medium{}, [](auto const& ptr) {
@@ -714,4 +1027,1114 @@ TEST_CASE("Copy pointers with active dynamic storage") {
             check_impl_is_constructed(impl_b, true, ptr2);
         });
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Allocator support") {
+    auto resource = counting_resource{};
+    auto const alloc = std::pmr::polymorphic_allocator<std::byte>{&resource};
+
+    auto const resource_of = [](auto const& ptr) {
+        auto const* derived = dynamic_cast<interface_pmr_impl const*>(ptr.get());
+        REQUIRE(derived != nullptr);
+        CHECK(derived->str == long_string);
+        return derived->str.get_allocator().resource();
+    };
+
+    SECTION("Heap objects are allocated through the allocator") {
+        auto ptr = sboptr::pmr::sbo_ptr<interface>{
+            std::allocator_arg,
+            alloc,
+            std::in_place_type<interface_pmr_impl>,
+            long_string,
+        };
+        CHECK(ptr.get_allocator() == alloc);
+        CHECK(ptr->foo() == interface_pmr_impl::foo_constant);
+        CHECK(resource_of(ptr) == &resource);
+        // The object and its string
+        CHECK(resource.allocations == 2);
+
+        ptr.reset();
+        CHECK(resource.deallocations == 2);
+        CHECK(resource.bytes_in_use == 0);
+    }
+
+    SECTION("Small buffer objects use the allocator for their members") {
+        auto ptr = sboptr::pmr::no_alloc_sbo_ptr<interface, sizeof(interface_pmr_impl)>{
+            std::allocator_arg,
+            alloc,
+            std::in_place_type<interface_pmr_impl>,
+            long_string,
+        };
+        CHECK(resource_of(ptr) == &resource);
+        CHECK(resource.allocations == 1);
+
+        // polymorphic_allocator does not propagate on copy construction
+        auto const copy = ptr;
+        CHECK(copy.get_allocator().resource() == std::pmr::get_default_resource());
+        CHECK(resource_of(copy) == std::pmr::get_default_resource());
+
+        auto const arena_copy = decltype(ptr){std::allocator_arg, alloc, ptr};
+        CHECK(resource_of(arena_copy) == &resource);
+        CHECK(resource.allocations == 2);
+    }
+
+    SECTION("Moving heap objects between resources") {
+        auto other_resource = counting_resource{};
+        auto const other_alloc = std::pmr::polymorphic_allocator<std::byte>{&other_resource};
+
+        auto ptr1 = sboptr::pmr::sbo_ptr<interface>{std::allocator_arg, alloc, interface_pmr_impl{long_string}};
+        auto ptr2 = sboptr::pmr::sbo_ptr<interface>{std::allocator_arg, other_alloc, std::move(ptr1)};
+        check_empty(ptr1);
+        CHECK(resource_of(ptr2) == &other_resource);
+        CHECK(resource.bytes_in_use == 0);
+
+        // Same resource; the object is just handed over
+        auto const allocations = other_resource.allocations;
+        auto ptr3 = std::move(ptr2);
+        check_empty(ptr2);
+        CHECK(resource_of(ptr3) == &other_resource);
+        CHECK(other_resource.allocations == allocations);
+
+        // polymorphic_allocator does not propagate on assignment
+        ptr1 = std::move(ptr3);
+        check_empty(ptr3);
+        CHECK(ptr1.get_allocator() == alloc);
+        CHECK(resource_of(ptr1) == &resource);
+        CHECK(other_resource.bytes_in_use == 0);
+
+        ptr2 = ptr1;
+        CHECK(ptr2.get_allocator() == other_alloc);
+        CHECK(resource_of(ptr2) == &other_resource);
+    }
+
+    SECTION("Containers pass their allocator to the elements") {
+        auto vec = std::pmr::vector<sboptr::pmr::sbo_ptr<interface>>{alloc};
+        vec.emplace_back(std::in_place_type<interface_pmr_impl>, long_string);
+        vec.emplace_back(interface_pmr_impl{long_string});
+        vec.emplace_back();
+
+        for (auto const& ptr : vec) {
+            CHECK(ptr.get_allocator() == alloc);
+        }
+        CHECK(resource_of(vec[0]) == &resource);
+        CHECK(resource_of(vec[1]) == &resource);
+
+        auto other_resource = counting_resource{};
+        auto const copy = std::pmr::vector<sboptr::pmr::sbo_ptr<interface>>{vec, &other_resource};
+        CHECK(resource_of(copy[0]) == &other_resource);
+        CHECK(resource_of(copy[1]) == &other_resource);
+        check_empty(copy[2]);
+
+        vec.clear();
+        vec.shrink_to_fit();
+        CHECK(resource.bytes_in_use == 0);
+    }
+}
+
+TEST_CASE("Pooled heap allocations") {
+    using ptr_t = sboptr::basic_sbo_ptr<interface, sizeof(void*) * 2, sboptr::movable | sboptr::allow_heap | sboptr::pooled>;
+    static_assert(std::is_same_v<ptr_t::allocator_type, sboptr::pool_allocator<std::byte>>);
+
+    sboptr::reset_pool_stats();
+
+    // Each section uses its own size class, as the thread cache outlives them
+
+    SECTION("Emplace / reset cycles reuse the memory") {
+        using impl_t = interface_big_impl<200>;
+
+        auto ptr = ptr_t{};
+        ptr.emplace<impl_t>();
+        auto const* const first_block = static_cast<void const*>(ptr.get());
+        CHECK(ptr->foo() == impl_t::foo_constant);
+
+        for (auto i = 0; i < 10; ++i) {
+            ptr.reset();
+            ptr.emplace<impl_t>();
+            CHECK(static_cast<void const*>(ptr.get()) == first_block);
+        }
+
+        auto const stats = sboptr::get_pool_stats();
+        CHECK(stats.misses == 1);
+        CHECK(stats.hits == 10);
+        CHECK(stats.oversize == 0);
+    }
+
+    SECTION("Small buffer objects do not touch the pool") {
+        using medium_ptr_t = sboptr::basic_sbo_ptr<interface, sizeof(interface_impl_a), sboptr::movable | sboptr::allow_heap | sboptr::pooled>;
+        auto ptr = medium_ptr_t{impl_a};
+        auto const stats = sboptr::get_pool_stats();
+        CHECK(stats.hits + stats.misses + stats.oversize == 0);
+    }
+
+    SECTION("Blocks freed on another thread come back through the depot") {
+        using impl_t = interface_big_impl<400>;
+        constexpr auto count = sboptr::detail::size_class_pool::magazine_capacity * 4;
+
+        auto ptrs = std::vector<ptr_t>(count);
+        for (auto& ptr : ptrs) {
+            ptr.emplace<impl_t>();
+        }
+        CHECK(sboptr::get_pool_stats().misses == count);
+
+        std::thread{[&] {
+            ptrs.clear();
+            CHECK(sboptr::get_pool_stats().depot_exports > 0);
+        }}.join();
+
+        for (auto i = std::size_t{}; i < count; ++i) {
+            ptrs.emplace_back(std::in_place_type<impl_t>);
+        }
+        auto const stats = sboptr::get_pool_stats();
+        CHECK(stats.misses == count);
+        CHECK(stats.hits == count);
+        CHECK(stats.depot_imports > 0);
+    }
+
+    SECTION("Blocks allocated after the thread cache is gone have the full class size") {
+        struct late_allocation {
+            void** block;
+
+            ~late_allocation() {
+                // Runs after the cache of the thread, which was constructed later
+                *block = sboptr::pool_allocator<std::byte>{}.allocate(17);
+            }
+        };
+
+        void* block = nullptr;
+        std::thread{[&] {
+            static thread_local auto late = late_allocation{&block};
+            sboptr::reset_pool_stats();
+        }}.join();
+        REQUIRE(block != nullptr);
+
+        // Freed into this thread's cache, and reused for a bigger size of the same class
+        sboptr::pool_allocator<std::byte>{}.deallocate(static_cast<std::byte*>(block), 17);
+        auto* const reused = sboptr::pool_allocator<std::byte>{}.allocate(32);
+        CHECK(static_cast<void*>(reused) == block);
+        std::fill_n(reused, 32, std::byte{0xAB});
+        sboptr::pool_allocator<std::byte>{}.deallocate(reused, 32);
+    }
+}
+
+TEST_CASE("Heap fallback statistics") {
+    struct counted_small_impl : interface {
+        auto foo() const noexcept -> int override { return 1; }
+    };
+    struct counted_big_impl : interface {
+        std::array<int, 32> data = {};
+        auto foo() const noexcept -> int override { return 2; }
+    };
+
+    constexpr auto sbo_size = sizeof(counted_small_impl);
+    using ptr_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::instrumented>;
+    using pinned_ptr_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::allow_heap | sboptr::instrumented>;
+
+    // Only the vtables of instrumented pointers carry the statistics record
+    using alloc_t = sboptr::default_allocator;
+    static_assert(
+        sboptr::detail::instrument_all
+        || sizeof(sboptr::detail::sbo_ptr_vtable_for_opts<interface, sboptr::movable | sboptr::allow_heap | sboptr::instrumented, alloc_t>)
+               == sizeof(sboptr::detail::sbo_ptr_vtable_for_opts<interface, sboptr::movable | sboptr::allow_heap, alloc_t>) + sizeof(void*));
+
+    auto const stats_of = [](std::string_view const name) {
+        auto const all = sboptr::get_heap_fallback_stats();
+        auto const iter = std::find_if(all.begin(), all.end(), [&](auto const& s) {
+            return s.type.size() >= name.size() && s.type.substr(s.type.size() - name.size()) == name;
+        });
+        REQUIRE(iter != all.end());
+        return *iter;
+    };
+
+    sboptr::reset_heap_fallback_stats();
+
+    auto small = ptr_t{std::in_place_type<counted_small_impl>};
+    auto big = ptr_t{std::in_place_type<counted_big_impl>};
+    auto const big_copy = big;
+    auto const moved = std::move(small);
+    auto const pinned = pinned_ptr_t{std::in_place_type<counted_big_impl>};
+    // Not instrumented
+    auto const other = sboptr::sbo_ptr<interface, sbo_size>{std::in_place_type<counted_small_impl>};
+
+    auto const small_stats = stats_of("counted_small_impl");
+    CHECK(small_stats.size == sizeof(counted_small_impl));
+    CHECK(small_stats.inline_constructions == 1);
+    CHECK(small_stats.heap_constructions == 0);
+    CHECK(small_stats.heap_bytes == 0);
+    CHECK(small_stats.copies == 0);
+    CHECK(small_stats.moves == 1);
+
+    auto const big_stats = stats_of("counted_big_impl");
+    CHECK(big_stats.inline_constructions == 0);
+    CHECK(big_stats.heap_constructions == 2);
+    CHECK(big_stats.heap_bytes == 3 * sizeof(counted_big_impl));
+    CHECK(big_stats.copies == 1);
+    CHECK(big_stats.moves == 0);
+
+    auto* const file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    sboptr::print_heap_fallback_stats(file);
+    std::rewind(file);
+    auto report = std::string(4096, '\0');
+    report.resize(std::fread(report.data(), 1, report.size(), file));
+    std::fclose(file);
+    CHECK(report.find("counted_big_impl") < report.find("counted_small_impl"));
+
+    sboptr::reset_heap_fallback_stats();
+    CHECK(stats_of("counted_big_impl").heap_constructions == 0);
+}
+
+TEST_CASE("Heap budgets") {
+    struct budget_small_impl : interface {
+        auto foo() const noexcept -> int override { return 1; }
+    };
+    struct budget_big_impl : interface {
+        std::array<int, 32> data = {};
+        auto foo() const noexcept -> int override { return 2; }
+    };
+
+    constexpr auto sbo_size = sizeof(budget_small_impl);
+    constexpr auto big_size = sizeof(budget_big_impl);
+    using ptr_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::budgeted>;
+    static_assert(noexcept(std::declval<ptr_t&>().try_emplace<budget_big_impl>()));
+    static_assert(!noexcept(std::declval<ptr_t&>().emplace<budget_big_impl>()));
+
+    auto budget = sboptr::heap_budget{2 * big_size};
+    auto const scope = sboptr::heap_budget_scope{budget};
+    CHECK(&sboptr::heap_budget::current() == &budget);
+
+    SECTION("Objects in the small buffer are not charged") {
+        auto ptr = ptr_t{};
+        CHECK(ptr.try_emplace<budget_small_impl>() == sboptr::emplace_status::success);
+        CHECK(ptr.holds<budget_small_impl>());
+        CHECK(budget.used() == 0);
+    }
+
+    SECTION("Heap objects are charged until destroyed") {
+        auto ptr1 = ptr_t{};
+        CHECK(ptr1.try_emplace<budget_big_impl>() == sboptr::emplace_status::success);
+        CHECK(budget.used() == big_size);
+        auto ptr2 = ptr_t{budget_big_impl{}};
+        CHECK(budget.used() == 2 * big_size);
+
+        auto ptr3 = ptr_t{budget_small_impl{}};
+        CHECK(ptr3.try_emplace<budget_big_impl>() == sboptr::emplace_status::over_budget);
+        CHECK(ptr3.holds<budget_small_impl>());
+        CHECK_THROWS_AS(ptr3.emplace<budget_big_impl>(), std::bad_alloc);
+        CHECK_THROWS_AS(ptr_t{ptr1}, std::bad_alloc);
+        CHECK(budget.used() == 2 * big_size);
+
+        ptr1.reset();
+        CHECK(budget.used() == big_size);
+        CHECK(ptr2.try_emplace<budget_small_impl>() == sboptr::emplace_status::success);
+        CHECK(budget.used() == 0);
+    }
+
+    SECTION("Moved objects keep their charge") {
+        auto ptr1 = ptr_t{budget_big_impl{}};
+        auto const ptr2 = std::move(ptr1);
+        CHECK(budget.used() == big_size);
+
+        budget.set_limit(big_size);
+        CHECK(ptr1.try_emplace<budget_big_impl>() == sboptr::emplace_status::over_budget);
+        CHECK(!ptr1);
+    }
+
+    SECTION("Objects are released to the budget charged") {
+        auto ptr = ptr_t{};
+        std::thread{[&] {
+            auto thread_budget = sboptr::heap_budget{};
+            {
+                auto const thread_scope = sboptr::heap_budget_scope{thread_budget};
+                ptr.emplace<budget_big_impl>();
+            }
+            CHECK(&sboptr::heap_budget::current() == &sboptr::heap_budget::global());
+            CHECK(thread_budget.used() == big_size);
+            ptr.reset();
+            CHECK(thread_budget.used() == 0);
+        }}.join();
+        CHECK(budget.used() == 0);
+    }
+
+    SECTION("Released objects are no longer charged") {
+        auto ptr = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::movable | sboptr::allow_heap | sboptr::budgeted>{budget_big_impl{}};
+        auto const released = ptr.release_to_unique();
+        CHECK(budget.used() == 0);
+
+        ptr.adopt(std::make_unique<budget_big_impl>());
+        CHECK(budget.used() == 0);
+    }
+
+    SECTION("Pointers without budget") {
+        auto ptr = sboptr::sbo_ptr<interface, sbo_size>{};
+        CHECK(ptr.try_emplace<budget_big_impl>() == sboptr::emplace_status::success);
+        CHECK(budget.used() == 0);
+
+        auto no_memory = sboptr::pmr::sbo_ptr<interface, sbo_size>{std::pmr::null_memory_resource()};
+        CHECK(no_memory.try_emplace<budget_big_impl>() == sboptr::emplace_status::out_of_memory);
+        CHECK(!no_memory);
+    }
+
+    SECTION("Exceptions of constructors are not reported as out of memory") {
+        struct throwing_big_impl : budget_big_impl {
+            throwing_big_impl() { throw std::bad_alloc{}; }
+        };
+
+        using cow_ptr_t = sboptr::basic_sbo_ptr<
+            interface, sbo_size, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow, std::pmr::polymorphic_allocator<std::byte>>;
+        auto ptr = cow_ptr_t{budget_small_impl{}};
+        CHECK_THROWS_AS(ptr.try_emplace<throwing_big_impl>(), std::bad_alloc);
+        CHECK(ptr.holds<budget_small_impl>());
+
+        auto no_memory = cow_ptr_t{std::pmr::null_memory_resource()};
+        CHECK(no_memory.try_emplace<budget_big_impl>() == sboptr::emplace_status::out_of_memory);
+        CHECK(!no_memory);
+    }
+}
+
+TEST_CASE("Trivially relocatable objects") {
+    using relocatable_ptr_t = sboptr::basic_sbo_ptr<
+        interface,
+        sizeof(interface_relocatable_impl),
+        sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::trivially_relocatable>;
+    static_assert(std::is_constructible_v<relocatable_ptr_t, interface_relocatable_impl>);
+    static_assert(!std::is_constructible_v<relocatable_ptr_t, interface_impl_a>);
+    static_assert(!sboptr::is_trivially_relocatable_v<sboptr::sbo_ptr<interface>>);
+    static_assert(sboptr::is_trivially_relocatable_v<compact_ptr<sizeof(interface), sboptr::movable | sboptr::trivially_relocatable>>);
+    static_assert(!sboptr::is_trivially_relocatable_v<compact_ptr<sizeof(interface), sboptr::movable>>);
+
+    auto const check_relocation = [](auto ptr1) {
+        interface_relocatable_impl::move_count = 0;
+
+        auto ptr2 = std::move(ptr1);
+        check_empty(ptr1);
+        REQUIRE(ptr2 != nullptr);
+        CHECK(ptr2->foo() == interface_relocatable_impl::foo_constant);
+        CHECK(dynamic_cast<interface_relocatable_impl const&>(*ptr2).interface_relocatable_impl::value == 42);
+
+        ptr1 = std::move(ptr2);
+        check_empty(ptr2);
+        REQUIRE(ptr1 != nullptr);
+        CHECK(dynamic_cast<interface_relocatable_impl const&>(*ptr1).value == 42);
+
+        CHECK(interface_relocatable_impl::move_count == 0);
+    };
+
+    check_relocation(relocatable_ptr_t{std::in_place_type<interface_relocatable_impl>, 42});
+    tuple_for_each(move_ptrs_medium{}, [&](auto const& ptr) {
+        using ptr_t = std::decay_t<decltype(ptr)>;
+        check_relocation(ptr_t{std::in_place_type<interface_relocatable_impl>, 42});
+    });
+}
+
+TEST_CASE("Compact layout") {
+    constexpr auto sbo_size = sizeof(void*) * 5;
+    static_assert(sizeof(compact_ptr<sbo_size, sboptr::movable>) == sizeof(void*) + sbo_size);
+    static_assert(sizeof(compact_ptr<sbo_size, sboptr::movable>) < sizeof(sboptr::unique_no_alloc_sbo_ptr<interface, sbo_size>));
+    // Room for the heap pointer
+    static_assert(sizeof(compact_ptr<1, sboptr::movable | sboptr::allow_heap>) == 2 * sizeof(void*));
+
+    struct over_aligned_impl : interface {
+        alignas(2 * alignof(void*)) int value = 0;
+        auto foo() const noexcept -> int override { return value; }
+    };
+    // The compact buffer is only pointer-aligned, so such objects go to the heap
+    static_assert(sboptr::unique_sbo_ptr<interface, 64>::stores_inline<over_aligned_impl>);
+    static_assert(!compact_ptr<64, sboptr::movable | sboptr::allow_heap>::stores_inline<over_aligned_impl>);
+    static_assert(sboptr::basic_sbo_ptr<interface, 64, sboptr::movable | sboptr::compact, sboptr::default_allocator, 16>::stores_inline<over_aligned_impl>);
+
+    SECTION("Base class at a non-zero offset") {
+        struct other_base {
+            virtual ~other_base() = default;
+            int value = 10;
+        };
+        struct impl : other_base, interface_relocatable_impl {
+            using interface_relocatable_impl::interface_relocatable_impl;
+        };
+
+        auto ptr1 = compact_ptr<sizeof(impl), sboptr::movable | sboptr::copyable>{std::in_place_type<impl>, 42};
+        REQUIRE(ptr1 != nullptr);
+        CHECK(static_cast<void*>(ptr1.get()) != static_cast<void*>(dynamic_cast<impl*>(ptr1.get())));
+        CHECK(ptr1->foo() == interface_relocatable_impl::foo_constant);
+
+        auto const ptr2 = ptr1;
+        auto const ptr3 = std::move(ptr1);
+        check_empty(ptr1);
+        CHECK(dynamic_cast<impl const&>(*ptr2).interface_relocatable_impl::value == 42);
+        CHECK(dynamic_cast<impl const&>(*ptr3).interface_relocatable_impl::value == 42);
+        CHECK(dynamic_cast<impl const&>(*ptr3).other_base::value == 10);
+    }
+}
+
+TEST_CASE("Heap flag packing") {
+    // The heap flag lives in the low bit of the vtable pointer, not in a separate member
+    static_assert(sizeof(sboptr::pinned_sbo_ptr<interface, sizeof(void*) * 3>) == sizeof(sboptr::pinned_no_alloc_sbo_ptr<interface, sizeof(void*) * 3>));
+    // Pinned pointers keep the object pointer, unless they use the compact layout
+    static_assert(sizeof(sboptr::pinned_no_alloc_sbo_ptr<interface, sizeof(void*) * 3>) == sizeof(sboptr::unique_no_alloc_sbo_ptr<interface, sizeof(void*) * 3>));
+    static_assert(sizeof(sboptr::basic_sbo_ptr<interface, sizeof(void*) * 3, sboptr::compact>) == sizeof(void*) * 4);
+    // Object pointer and vtable, padded to the buffer alignment, then the buffer
+    static_assert(
+        sizeof(sboptr::pinned_no_alloc_sbo_ptr<interface, 32>)
+        == std::max(sizeof(void*) * 2, alignof(std::max_align_t)) + 32);
+
+    auto ptr = sboptr::pinned_sbo_ptr<interface, sizeof(interface)>{std::in_place_type<interface_impl_b>, "a", "b"};
+    REQUIRE(ptr != nullptr);
+    CHECK(reinterpret_cast<std::uintptr_t>(ptr.get()) % alignof(interface) == 0);
+    CHECK(ptr->foo() == interface_impl_b::foo_constant);
+    ptr = nullptr;
+    check_empty(ptr);
+}
+
+TEST_CASE("Over-aligned objects") {
+    struct alignas(64) simd_impl : interface {
+        std::array<float, 8> lanes = {};
+        auto foo() const noexcept -> int override { return 7; }
+    };
+    constexpr auto sbo_size = sizeof(simd_impl);
+
+    auto const check_alignment = [](auto const& ptr, bool const expect_inline) {
+        REQUIRE(ptr != nullptr);
+        CHECK(ptr->foo() == 7);
+        CHECK(reinterpret_cast<std::uintptr_t>(ptr.get()) % alignof(simd_impl) == 0);
+        auto const* const object = reinterpret_cast<std::byte const*>(ptr.get());
+        auto const* const self = reinterpret_cast<std::byte const*>(&ptr);
+        CHECK((object >= self && object < self + sizeof(ptr)) == expect_inline);
+    };
+
+    SECTION("Default alignment falls back to the heap") {
+        using ptr_t = sboptr::sbo_ptr<interface, sbo_size>;
+        static_assert(!ptr_t::stores_inline<simd_impl>);
+        static_assert(!std::is_nothrow_constructible_v<ptr_t, std::in_place_type_t<simd_impl>>);
+
+        auto ptr = ptr_t{std::in_place_type<simd_impl>};
+        check_alignment(ptr, false);
+        auto const copy = ptr;
+        check_alignment(copy, false);
+        check_alignment(sboptr::pinned_sbo_ptr<interface, sbo_size>{std::in_place_type<simd_impl>}, false);
+        check_alignment(compact_ptr<sbo_size, sboptr::movable | sboptr::allow_heap>{std::in_place_type<simd_impl>}, false);
+    }
+
+    SECTION("Aligned buffers store them in place") {
+        using ptr_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::movable | sboptr::copyable | sboptr::allow_heap, sboptr::default_allocator, 64>;
+        static_assert(ptr_t::stores_inline<simd_impl>);
+        static_assert(alignof(ptr_t) == 64);
+
+        auto ptr = ptr_t{std::in_place_type<simd_impl>};
+        check_alignment(ptr, true);
+        auto const copy = ptr;
+        check_alignment(copy, true);
+        auto const moved = std::move(ptr);
+        check_alignment(moved, true);
+
+        using pinned_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::no_options, sboptr::default_allocator, 64>;
+        check_alignment(pinned_t{std::in_place_type<simd_impl>}, true);
+        using compact_t = sboptr::basic_sbo_ptr<interface, sbo_size, sboptr::movable | sboptr::compact, sboptr::default_allocator, 64>;
+        check_alignment(compact_t{std::in_place_type<simd_impl>}, true);
+    }
+
+    SECTION("Auto-sized pointers take the alignment of the listed types") {
+        using ptr_t = sboptr::unique_no_alloc_sbo_ptr_for<interface, simd_impl, interface_relocatable_impl>;
+        static_assert(ptr_t::stores_inline<simd_impl>);
+        check_alignment(ptr_t{std::in_place_type<simd_impl>}, true);
+    }
+}
+
+TEST_CASE("Cache line alignment") {
+    using ptr_t = sboptr::basic_sbo_ptr<interface, 48, sboptr::movable | sboptr::allow_heap | sboptr::cache_aligned>;
+    static_assert(alignof(ptr_t) == sboptr::cache_line_size);
+    static_assert(sizeof(ptr_t) % sboptr::cache_line_size == 0);
+    static_assert(alignof(sboptr::unique_sbo_ptr<interface, 48>) < sboptr::cache_line_size);
+
+    auto ptrs = std::vector<ptr_t>{};
+    ptrs.emplace_back(std::in_place_type<interface_relocatable_impl>, 1);
+    ptrs.emplace_back(std::in_place_type<interface_big_impl<64>>);
+    ptrs.emplace_back(std::in_place_type<interface_relocatable_impl>, 3);
+    for (auto const& ptr : ptrs) {
+        CHECK(reinterpret_cast<std::uintptr_t>(&ptr) % sboptr::cache_line_size == 0);
+    }
+    CHECK(ptrs[1]->foo() == interface_big_impl<64>::foo_constant);
+    CHECK(dynamic_cast<interface_relocatable_impl const&>(*ptrs[2]).value == 3);
+}
+
+TEST_CASE("Auto-sized pointers") {
+    constexpr auto max_size = std::max(sizeof(interface_impl_a), sizeof(interface_impl_b));
+    using ptr_t = sboptr::sbo_ptr_for<interface, interface_impl_a, interface_impl_b>;
+#ifdef SBOPTR_HAS_CONSTEXPR_CONSTRUCTION
+    // The buffer has members for the listed types, with the same layout
+    static_assert(sizeof(ptr_t) == sizeof(sboptr::sbo_ptr<interface, max_size>));
+    static_assert(alignof(ptr_t) == alignof(sboptr::sbo_ptr<interface, max_size>));
+    static_assert(sizeof(sboptr::pmr::pinned_sbo_ptr_for<interface, interface_impl_a>) == sizeof(sboptr::pmr::pinned_sbo_ptr<interface, sizeof(interface_impl_a)>));
+#else
+    static_assert(std::is_same_v<ptr_t, sboptr::sbo_ptr<interface, max_size>>);
+    static_assert(std::is_same_v<sboptr::unique_no_alloc_sbo_ptr_for<interface, interface_impl_b, interface_impl_a>, sboptr::unique_no_alloc_sbo_ptr<interface, max_size>>);
+    static_assert(std::is_same_v<sboptr::pmr::pinned_sbo_ptr_for<interface, interface_impl_a>, sboptr::pmr::pinned_sbo_ptr<interface, sizeof(interface_impl_a)>>);
+#endif
+
+    static_assert(ptr_t::stores_inline<interface_impl_a>);
+    static_assert(ptr_t::stores_inline<interface_impl_b>);
+    static_assert(!ptr_t::stores_inline<interface_big_impl<max_size>>);
+
+    auto ptr = ptr_t{std::in_place_type<interface_impl_b>, "a", "b"};
+    REQUIRE(ptr != nullptr);
+    CHECK_FALSE(dynamic_cast<interface_impl_b&>(*ptr).is_dyn_allocated());
+    ptr.emplace<interface_impl_a>("a");
+    CHECK_FALSE(dynamic_cast<interface_impl_a&>(*ptr).is_dyn_allocated());
+
+    // Unlisted types still fall back to the heap
+    ptr.emplace<interface_big_impl<max_size>>();
+    CHECK(ptr->foo() == interface_big_impl<max_size>::foo_constant);
+}
+
+TEST_CASE("Copy on write") {
+    using big_t = interface_big_impl<64>;
+    using ptr_t = sboptr::basic_sbo_ptr<interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow>;
+    static_assert(!noexcept(std::declval<ptr_t&>().get()));
+    static_assert(noexcept(std::declval<ptr_t const&>().get()));
+
+    SECTION("Heap copies share the object until modified") {
+        auto ptr = ptr_t{std::in_place_type<big_t>};
+        auto const copy = ptr;
+        CHECK(std::as_const(ptr).get() == copy.get());
+
+        dynamic_cast<big_t&>(*ptr).data[0] = 'x';
+        CHECK(std::as_const(ptr).get() != copy.get());
+        CHECK(dynamic_cast<big_t const&>(*copy).data[0] == '\0');
+
+        // Unique objects are modified in place
+        auto* const object = ptr.get();
+        CHECK(ptr.get() == object);
+    }
+
+    SECTION("Copies never compare equal, shared or not") {
+        auto ptr = ptr_t{std::in_place_type<big_t>};
+        auto const copy = ptr;
+        CHECK(std::as_const(ptr).get() == copy.get());
+        CHECK(ptr != copy);
+        CHECK(ptr == std::as_const(ptr));
+
+        static_cast<void>(ptr.get());
+        CHECK(ptr != copy);
+
+        auto empty = ptr_t{};
+        CHECK(empty == ptr_t{});
+        CHECK(empty != ptr);
+    }
+
+    SECTION("Non-const accessors unshare the object, const ones do not") {
+        auto ptr = ptr_t{std::in_place_type<big_t>};
+        auto const copy = ptr;
+
+        CHECK(std::as_const(ptr).get_if<big_t>() == copy.get_if<big_t>());
+        sboptr::visit<big_t>(std::as_const(ptr), [](auto const&) {});
+        CHECK(std::as_const(ptr).get() == copy.get());
+
+        // Not of the type asked for, so nothing to unshare
+        CHECK(ptr.get_if<interface_impl_a>() == nullptr);
+        CHECK(std::as_const(ptr).get() == copy.get());
+
+        sboptr::visit<big_t>(ptr, [](auto&) {});
+        CHECK(std::as_const(ptr).get() != copy.get());
+
+        auto other = copy;
+        auto* const object = other.get_if<big_t>();
+        CHECK(object != copy.get_if<big_t>());
+        CHECK(other.get_if<big_t>() == object);
+    }
+
+    SECTION("Inline objects are copied eagerly") {
+        auto const ptr = ptr_t{std::in_place_type<interface_relocatable_impl>, 1};
+        auto const copy = ptr;
+        CHECK(ptr.get() != copy.get());
+    }
+
+    SECTION("The last owner frees the object") {
+        auto resource = counting_resource{};
+        using pmr_ptr_t = sboptr::basic_sbo_ptr<
+            interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow, std::pmr::polymorphic_allocator<std::byte>>;
+        {
+            auto ptr = pmr_ptr_t{std::allocator_arg, &resource, std::in_place_type<interface_pmr_impl>, long_string};
+            auto const allocations = resource.allocations;
+            auto copies = std::vector<pmr_ptr_t>{};
+            for (auto i = 0; i < 3; ++i) {
+                copies.emplace_back(std::allocator_arg, &resource, ptr);
+            }
+            CHECK(resource.allocations == allocations);
+
+            // Uses-allocator construction still applies to the unshared copy
+            auto& impl = dynamic_cast<interface_pmr_impl&>(*copies[0]);
+            CHECK(impl.str.get_allocator().resource() == &resource);
+            CHECK(resource.allocations > allocations);
+
+            ptr = nullptr;
+            copies.clear();
+        }
+        CHECK(resource.bytes_in_use == 0);
+        CHECK(resource.allocations == resource.deallocations);
+    }
+
+    SECTION("Copies with another allocator are eager") {
+        auto resource = counting_resource{};
+        using pmr_ptr_t = sboptr::basic_sbo_ptr<
+            interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow, std::pmr::polymorphic_allocator<std::byte>>;
+        auto const ptr = pmr_ptr_t{std::allocator_arg, &resource, std::in_place_type<big_t>};
+        auto const copy = pmr_ptr_t{ptr};
+        CHECK(ptr.get() != copy.get());
+        CHECK(resource.allocations == 1);
+    }
+
+    SECTION("Shared objects across threads") {
+        auto const ptr = ptr_t{std::in_place_type<big_t>};
+        auto threads = std::vector<std::thread>{};
+        for (auto t = 0; t < 4; ++t) {
+            threads.emplace_back([&ptr] {
+                for (auto i = 0; i < 1000; ++i) {
+                    auto copy = ptr;
+                    dynamic_cast<big_t&>(*copy).data[0] = 'x';
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(dynamic_cast<big_t const&>(*ptr).data[0] == '\0');
+    }
+}
+
+TEST_CASE("Storage reuse") {
+    using same_block_impl = interface_big_impl<sizeof(counted_impl) - sizeof(interface)>;
+    static_assert(sizeof(same_block_impl) == sizeof(counted_impl));
+    static_assert(sboptr::detail::has_class_allocation<interface_impl_a>::value);
+    static_assert(!sboptr::detail::has_class_allocation<counted_impl>::value);
+
+    counted_impl::constructions = 0;
+    counted_impl::assignments = 0;
+
+    SECTION("Same type assignments assign in place") {
+        auto ptr = sboptr::sbo_ptr<interface, 16>{counted_impl{}};
+        auto const* const object = ptr.get();
+        counted_impl::constructions = 0;
+
+        auto value = counted_impl{};
+        value.data[0] = 1;
+        ptr = value;
+        CHECK(ptr.get() == object);
+        CHECK(ptr->foo() == 1);
+        value.data[0] = 2;
+        ptr = std::move(value);
+        CHECK(ptr.get() == object);
+        CHECK(ptr->foo() == 2);
+        CHECK(counted_impl::constructions == 1);
+        CHECK(counted_impl::assignments == 2);
+
+        auto inline_ptr = sboptr::sbo_ptr<interface, sizeof(counted_impl)>{counted_impl{}};
+        auto const* const inline_object = inline_ptr.get();
+        inline_ptr = value;
+        CHECK(inline_ptr.get() == inline_object);
+        CHECK(counted_impl::assignments == 3);
+    }
+
+    SECTION("Copy assignment to the heap makes no temporary") {
+        auto ptr = sboptr::sbo_ptr<interface, 16>{interface_impl_b{"a", "b"}};
+        auto value = counted_impl{};
+        value.data[0] = 5;
+        counted_impl::constructions = 0;
+
+        ptr = value;
+        CHECK(counted_impl::constructions == 1);
+        CHECK(ptr->foo() == 5);
+
+        // The object held survives a throwing copy
+        auto const throwing = interface_copy_throw_impl{"c"};
+        CHECK_THROWS_AS(ptr = throwing, std::runtime_error);
+        REQUIRE(ptr.holds<counted_impl>());
+        CHECK(ptr->foo() == 5);
+    }
+
+    SECTION("Heap blocks are reused by types of the same size") {
+        auto resource = counting_resource{};
+        using ptr_t = sboptr::pmr::unique_sbo_ptr<interface, 16>;
+        auto ptr = ptr_t{std::allocator_arg, &resource, std::in_place_type<counted_impl>};
+        auto const* const block = dynamic_cast<void const*>(ptr.get());
+        CHECK(resource.allocations == 1);
+
+        ptr.emplace<same_block_impl>();
+        CHECK(resource.allocations == 1);
+        CHECK(dynamic_cast<void const*>(ptr.get()) == block);
+        CHECK(ptr->foo() == same_block_impl::foo_constant);
+
+        ptr = counted_impl{};
+        CHECK(resource.allocations == 1);
+
+        ptr.emplace<interface_big_impl<128>>();
+        CHECK(resource.allocations == 2);
+        ptr = nullptr;
+        CHECK(resource.bytes_in_use == 0);
+    }
+
+    SECTION("Pooled blocks are reused within a size class") {
+        using ptr_t = sboptr::basic_sbo_ptr<interface, 16, sboptr::movable | sboptr::allow_heap | sboptr::pooled>;
+        static_assert(sizeof(interface_big_impl<32>) != sizeof(interface_big_impl<40>));
+        auto ptr = ptr_t{std::in_place_type<interface_big_impl<32>>};
+        auto const* const block = dynamic_cast<void const*>(ptr.get());
+        ptr.emplace<interface_big_impl<40>>();
+        CHECK(dynamic_cast<void const*>(ptr.get()) == block);
+    }
+
+    SECTION("Shared objects are not assigned to") {
+        using ptr_t = sboptr::basic_sbo_ptr<interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow>;
+        auto ptr = ptr_t{counted_impl{}};
+        auto const copy = ptr;
+        auto value = counted_impl{};
+        value.data[0] = 1;
+        ptr = value;
+        CHECK(counted_impl::assignments == 0);
+        CHECK(ptr->foo() == 1);
+        CHECK(copy->foo() == 0);
+
+        ptr = value;
+        CHECK(counted_impl::assignments == 1);
+    }
+}
+
+TEST_CASE("Unique pointer interop") {
+    using ptr_t = sboptr::sbo_ptr<interface, 16>;
+    static_assert(ptr_t::interoperates_with_unique_ptr);
+    static_assert(!sboptr::pmr::sbo_ptr<interface, 16>::interoperates_with_unique_ptr);
+    static_assert(!sboptr::basic_sbo_ptr<interface, 16, sboptr::movable | sboptr::allow_heap | sboptr::pooled>::interoperates_with_unique_ptr);
+    static_assert(!sboptr::basic_sbo_ptr<interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow>::interoperates_with_unique_ptr);
+
+    counted_impl::constructions = 0;
+
+    SECTION("Adopted objects are not moved") {
+        auto object = std::make_unique<counted_impl>();
+        object->data[0] = 4;
+        auto const* const address = object.get();
+
+        auto ptr = ptr_t{};
+        ptr.adopt(std::move(object));
+        CHECK(ptr.get() == address);
+        CHECK(ptr.holds<counted_impl>());
+        CHECK(counted_impl::constructions == 1);
+
+        auto moved = std::move(ptr);
+        CHECK(moved.get() == address);
+        auto const copy = moved;
+        CHECK(copy->foo() == 4);
+        CHECK(copy.get() != address);
+    }
+
+    SECTION("Objects fitting the buffer stay on the heap") {
+        auto object = std::make_unique<interface_big_impl<4>>();
+        auto const* const address = object.get();
+        auto ptr = ptr_t{interface_big_impl<8>{}};
+        ptr.adopt(std::move(object));
+        CHECK(ptr.get() == address);
+
+        auto moved = std::move(ptr);
+        CHECK(moved.get() == address);
+    }
+
+    SECTION("Class-specific allocation") {
+        auto object = std::make_unique<interface_impl_a>("a");
+        auto ptr = ptr_t{};
+        ptr.adopt(std::move(object));
+        CHECK(ptr.get_if<interface_impl_a>()->is_dyn_allocated());
+
+        auto released = ptr.release_to_unique();
+        CHECK(static_cast<interface_impl_a const*>(released.get())->is_dyn_allocated());
+        released.reset();
+        CHECK(std::none_of(interface_impl_a::new_buffers.begin(), interface_impl_a::new_buffers.end(), [](auto const& buff) {
+            return buff.has_value();
+        }));
+    }
+
+    SECTION("Released heap objects are not moved") {
+        auto ptr = ptr_t{counted_impl{}};
+        auto const* const address = ptr.get();
+        counted_impl::constructions = 0;
+
+        auto released = ptr.release_to_unique();
+        CHECK(released.get() == address);
+        CHECK(!ptr);
+        CHECK(counted_impl::constructions == 0);
+    }
+
+    SECTION("Released objects in the small buffer are moved to the heap") {
+        auto ptr = sboptr::sbo_ptr<interface, sizeof(counted_impl)>{counted_impl{}};
+        ptr.get_if<counted_impl>()->data[0] = 6;
+        counted_impl::constructions = 0;
+
+        auto released = ptr.release_to_unique();
+        CHECK(!ptr);
+        CHECK(released->foo() == 6);
+        CHECK(counted_impl::constructions == 1);
+    }
+
+#if defined(__cpp_rtti) || defined(_CPPRTTI)
+    SECTION("Adopting a more derived object is caught") {
+        class derived_impl : public counted_impl {};
+
+        assertion_failures = 0;
+        auto ptr = ptr_t{};
+        ptr.adopt(std::make_unique<counted_impl>());
+        CHECK(assertion_failures == 0);
+        ptr.adopt(std::unique_ptr<counted_impl>{std::make_unique<derived_impl>()});
+        CHECK(assertion_failures == 1);
+
+        // Handed back, to be deleted through the virtual destructor
+        ptr.release_to_unique().reset();
+    }
+#endif
+
+    SECTION("Empty pointers") {
+        auto ptr = ptr_t{counted_impl{}};
+        ptr.adopt(std::unique_ptr<counted_impl>{});
+        CHECK(!ptr);
+        CHECK(ptr.release_to_unique() == nullptr);
+    }
+}
+
+TEST_CASE("Bases without virtual destructor") {
+    static_assert(!std::has_virtual_destructor_v<plain_interface>);
+    static_assert(std::is_trivially_destructible_v<trivial_impl>);
+
+    using small_impl = plain_impl<4>;
+    using big_impl = plain_impl<64>;
+    plain_instances = 0;
+
+    SECTION("Pinned") {
+        {
+            auto ptr = sboptr::pinned_no_alloc_sbo_ptr<plain_interface, 16>{std::in_place_type<small_impl>};
+            CHECK(plain_instances == 1);
+            CHECK(ptr.holds<small_impl>());
+            ptr.emplace<trivial_impl>();
+            CHECK(plain_instances == 0);
+            CHECK(ptr.holds<trivial_impl>());
+            ptr.emplace<small_impl>();
+        }
+        CHECK(plain_instances == 0);
+
+        auto resource = counting_resource{};
+        {
+            using ptr_t = sboptr::basic_sbo_ptr<plain_interface, 16, sboptr::allow_heap, std::pmr::polymorphic_allocator<std::byte>>;
+            auto ptr = ptr_t{std::allocator_arg, &resource, std::in_place_type<big_impl>};
+            CHECK(resource.allocations == 1);
+            ptr.emplace<small_impl>();
+            CHECK(resource.bytes_in_use == 0);
+            ptr.emplace<big_impl>();
+        }
+        CHECK(plain_instances == 0);
+        CHECK(resource.bytes_in_use == 0);
+    }
+
+    SECTION("Movable") {
+        {
+            auto ptr = sboptr::unique_no_alloc_sbo_ptr<plain_interface, 16>{small_impl{}};
+            auto moved = std::move(ptr);
+            CHECK(plain_instances == 1);
+            moved = trivial_impl{};
+            CHECK(plain_instances == 0);
+            ptr = small_impl{};
+        }
+        CHECK(plain_instances == 0);
+    }
+
+    SECTION("Heap objects") {
+        {
+            auto ptr = sboptr::sbo_ptr<plain_interface, 16>{big_impl{}};
+            auto const copy = ptr;
+            auto small = sboptr::sbo_ptr<plain_interface, 16>{small_impl{}};
+            auto const small_copy = small;
+            CHECK(plain_instances == 4);
+            ptr.reset();
+            small.reset();
+            CHECK(plain_instances == 2);
+
+            auto pooled = sboptr::basic_sbo_ptr<plain_interface, 16, sboptr::movable | sboptr::allow_heap | sboptr::pooled>{big_impl{}};
+            auto cow = sboptr::basic_sbo_ptr<plain_interface, 16, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow>{big_impl{}};
+            auto const shared = cow;
+            CHECK(plain_instances == 4);
+        }
+        CHECK(plain_instances == 0);
+    }
+}
+
+TEST_CASE("External polymorphism") {
+    static_assert(!std::is_polymorphic_v<ext_square>);
+    static_assert(std::is_same_v<sboptr::sbo_ptr<ext_shape, 8>::element_type, void>);
+
+    SECTION("Objects in the small buffer") {
+        auto ptr = sboptr::sbo_ptr<ext_shape, 8>{ext_square{3}};
+        CHECK(ptr.stores_inline<ext_rect>);
+        CHECK(ptr.ops().area(ptr.get()) == 9);
+        CHECK(ptr.holds<ext_square>());
+        CHECK(!ptr.holds<ext_rect>());
+        REQUIRE(ptr.get_if<ext_square>());
+        CHECK(ptr.get_if<ext_square>()->side == 3);
+
+        auto copy = ptr;
+        copy.ops().scale(copy.get(), 2);
+        CHECK(copy.ops().area(copy.get()) == 36);
+        CHECK(ptr.ops().area(ptr.get()) == 9);
+
+        ptr = ext_rect{2, 5};
+        CHECK(ptr.ops().area(ptr.get()) == 10);
+        auto moved = std::move(ptr);
+        CHECK(!ptr);
+        CHECK(moved.ops().area(moved.get()) == 10);
+        // Assigned in place
+        auto const* const object = moved.get();
+        moved = ext_rect{1, 1};
+        CHECK(moved.get() == object);
+    }
+
+    SECTION("Heap objects") {
+        ext_instances = 0;
+        {
+            auto ptr = sboptr::sbo_ptr<ext_shape, 8>{ext_polygon{2}};
+            CHECK(!ptr.stores_inline<ext_polygon>);
+            auto copy = ptr;
+            copy.ops().scale(copy.get(), 3);
+            CHECK(ptr.ops().area(ptr.get()) == 32);
+            CHECK(copy.ops().area(copy.get()) == 96);
+            CHECK(ext_instances == 2);
+            copy = ext_square{1};
+            CHECK(ext_instances == 1);
+        }
+        CHECK(ext_instances == 0);
+    }
+
+    SECTION("Pointer kinds") {
+        ext_instances = 0;
+        {
+            auto pinned = sboptr::pinned_no_alloc_sbo_ptr<ext_shape, 8>{ext_rect{3, 4}};
+            CHECK(pinned.ops().area(pinned.get()) == 12);
+            CHECK(pinned.holds<ext_rect>());
+
+            auto pinned_heap = sboptr::basic_sbo_ptr<ext_shape, 8, sboptr::allow_heap>{std::in_place_type<ext_polygon>, 1};
+            CHECK(pinned_heap.ops().area(pinned_heap.get()) == 16);
+
+            auto unique = sboptr::unique_no_alloc_sbo_ptr<ext_shape, 8>{ext_square{5}};
+            auto moved = std::move(unique);
+            CHECK(moved.ops().area(moved.get()) == 25);
+
+            using compact_ptr = sboptr::basic_sbo_ptr<ext_shape, 8, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::compact>;
+            auto compact = compact_ptr{ext_rect{2, 2}};
+            auto compact_heap = compact_ptr{ext_polygon{1}};
+            auto const compact_copy = compact;
+            CHECK(compact_copy.ops().area(compact_copy.get()) == 4);
+            CHECK(compact_heap.ops().area(compact_heap.get()) == 16);
+
+            using cow_ptr = sboptr::basic_sbo_ptr<ext_shape, 8, sboptr::movable | sboptr::copyable | sboptr::allow_heap | sboptr::cow>;
+            auto cow = cow_ptr{ext_polygon{1}};
+            auto shared = cow;
+            CHECK(std::as_const(shared).get() == std::as_const(cow).get());
+            shared.ops().scale(shared.get(), 2);
+            CHECK(cow.ops().area(cow.get()) == 16);
+            CHECK(shared.ops().area(shared.get()) == 32);
+        }
+        CHECK(ext_instances == 0);
+    }
+
+    SECTION("Allocators and other pointers are not stored") {
+        using pmr_ptr = sboptr::pmr::sbo_ptr<ext_shape, 64>;
+        static_assert(!std::is_constructible_v<pmr_ptr, std::in_place_type_t<std::pmr::polymorphic_allocator<std::byte>>>);
+
+        auto resource = std::pmr::monotonic_buffer_resource{};
+        auto alloc = std::pmr::polymorphic_allocator<std::byte>{&resource};
+        auto const from_alloc = pmr_ptr{alloc};
+        CHECK(!from_alloc);
+        CHECK(from_alloc.get_allocator().resource() == &resource);
+
+        using small_ptr = sboptr::sbo_ptr<ext_shape, 16>;
+        using big_ptr = sboptr::sbo_ptr<ext_shape, 32>;
+        static_assert(!std::is_constructible_v<big_ptr, small_ptr&>);
+        static_assert(!std::is_constructible_v<big_ptr, small_ptr&&>);
+        static_assert(!std::is_constructible_v<big_ptr, std::in_place_type_t<small_ptr>, small_ptr const&>);
+        static_assert(!std::is_assignable_v<big_ptr&, small_ptr const&>);
+        static_assert(std::is_constructible_v<big_ptr, ext_square>);
+    }
+
+    SECTION("Operations of a base class") {
+        auto ptr = sboptr::sbo_ptr<record, 16>{point_record{1, 2}};
+        CHECK(ptr.ops().serialize(*ptr) == "1,2");
+        ptr = name_record{"a name that does not fit the small buffer"};
+        CHECK(ptr.ops().serialize(*ptr) == "a name that does not fit the small buffer");
+    }
+}
+
+TEST_CASE("Type queries") {
+    struct interface_impl_a_derived : interface_impl_a {
+        using interface_impl_a::interface_impl_a;
+    };
+
+    auto const check_holds_exactly = [](auto& ptr, auto const* const expected) {
+        using T = std::remove_cv_t<std::remove_pointer_t<decltype(expected)>>;
+        CHECK(ptr.template holds<T>());
+        CHECK(ptr.template get_if<T>() == expected);
+        CHECK(std::as_const(ptr).template get_if<T>() == expected);
+    };
+
+    SECTION("Objects in small buffer") {
+        tuple_for_each(ptrs_big{}, [&](auto const& ptr) {
+            using ptr_t = std::decay_t<decltype(ptr)>;
+            CHECK_FALSE(ptr.template holds<interface_impl_a>());
+            CHECK(ptr.template get_if<interface_impl_a>() == nullptr);
+
+            auto ptr_holding_a = ptr_t{impl_a};
+            check_holds_exactly(ptr_holding_a, static_cast<interface_impl_a*>(ptr_holding_a.get()));
+            CHECK_FALSE(ptr_holding_a.template holds<interface_impl_b>());
+            CHECK(ptr_holding_a.template get_if<interface_impl_b>() == nullptr);
+
+            auto ptr_holding_b = ptr_t{impl_b};
+            check_holds_exactly(ptr_holding_b, static_cast<interface_impl_b*>(ptr_holding_b.get()));
+            CHECK_FALSE(ptr_holding_b.template holds<interface_impl_a>());
+
+            // Only the exact type matches
+            auto ptr_holding_derived = ptr_t{std::in_place_type<interface_impl_a_derived>, long_string};
+            CHECK(ptr_holding_derived.template holds<interface_impl_a_derived>());
+            CHECK_FALSE(ptr_holding_derived.template holds<interface_impl_a>());
+        });
+    }
+
+    SECTION("Objects in dynamic storage") {
+        tuple_for_each(alloc_ptrs_small{}, [&](auto const& ptr) {
+            using ptr_t = std::decay_t<decltype(ptr)>;
+            auto ptr_holding_b = ptr_t{impl_b};
+            check_holds_exactly(ptr_holding_b, static_cast<interface_impl_b*>(ptr_holding_b.get()));
+            CHECK_FALSE(ptr_holding_b.template holds<interface_impl_a>());
+
+            ptr_holding_b.reset();
+            CHECK_FALSE(ptr_holding_b.template holds<interface_impl_b>());
+        });
+    }
+}
+
+TEST_CASE("Visit") {
+    struct visitor {
+        auto operator()(interface_impl_a& a) const -> std::string { return "a:" + a.str; }
+        auto operator()(interface_impl_b const& b) const -> std::string { return "b:" + b.str_a; }
+        auto operator()(interface const&) const -> std::string { return "base"; }
+    };
+
+    tuple_for_each(ptrs_big{}, [](auto const& ptr) {
+        using ptr_t = std::decay_t<decltype(ptr)>;
+        auto ptr_holding_a = ptr_t{std::in_place_type<interface_impl_a>, "x"};
+        auto ptr_holding_b = ptr_t{std::in_place_type<interface_impl_b>, "y", "z"};
+
+        CHECK(sboptr::visit<interface_impl_a, interface_impl_b>(ptr_holding_a, visitor{}) == "a:x");
+        CHECK(sboptr::visit<interface_impl_a, interface_impl_b>(ptr_holding_b, visitor{}) == "b:y");
+        CHECK(sboptr::visit<interface_impl_b, interface_impl_a>(std::as_const(ptr_holding_b), visitor{}) == "b:y");
+
+        // Types not listed go to the fallback
+        CHECK(sboptr::visit<interface_impl_b>(ptr_holding_a, visitor{}) == "base");
+        CHECK(sboptr::visit<>(ptr_holding_b, visitor{}) == "base");
+
+        // The visitor can modify the object
+        sboptr::visit<interface_impl_a>(ptr_holding_a, [](auto& object) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(object)>, interface_impl_a>) {
+                object.str = "modified";
+            }
+        });
+        CHECK(sboptr::visit<interface_impl_a>(ptr_holding_a, visitor{}) == "a:modified");
+    });
+}
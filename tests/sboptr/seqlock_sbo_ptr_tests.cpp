@@ -0,0 +1,282 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "sboptr/seqlock_sbo_ptr.hpp"
+
+namespace {
+
+class config {
+  public:
+    virtual ~config() = default;
+
+    // Every field holds the same version, unless a read tore
+    [[nodiscard]] virtual auto consistent_version() const -> int = 0;
+};
+
+class limits final : public config {
+  public:
+    int version;
+    int low;
+    int high;
+
+    explicit limits(int version) : version{version}, low{version}, high{version} {}
+
+    auto consistent_version() const -> int override { return low == version && high == version ? version : -1; }
+};
+
+// Throws from its constructor, after the old value was read by the test
+class throwing final : public config {
+  public:
+    explicit throwing(int) { throw std::runtime_error{"throwing"}; }
+
+    auto consistent_version() const -> int override { return -1; }
+};
+
+class named final : public config {
+  public:
+    static inline std::atomic<int> instances = 0;
+
+    int version;
+    std::string name;
+
+    explicit named(int version) : version{version}, name(64, static_cast<char>('a' + version % 26)) { ++instances; }
+    named(named const& other) : version{other.version}, name{other.name} { ++instances; }
+    named(named&& other) noexcept : version{other.version}, name{std::move(other.name)} { ++instances; }
+    ~named() override { --instances; }
+
+    auto consistent_version() const -> int override {
+        return name == std::string(64, static_cast<char>('a' + version % 26)) ? version : -1;
+    }
+};
+
+// Copies wait while closed, to keep a load in progress
+class gated final : public config {
+  public:
+    static inline std::atomic<bool> closed = false;
+    static inline std::atomic<int> waiting = 0;
+    static inline std::atomic<int> instances = 0;
+
+    int version;
+
+    explicit gated(int version) : version{version} { ++instances; }
+    gated(gated const& other) : version{other.version} {
+        ++instances;
+        ++waiting;
+        while (closed) {
+            std::this_thread::yield();
+        }
+        --waiting;
+    }
+    gated(gated&& other) noexcept : version{other.version} { ++instances; }
+    ~gated() override { --instances; }
+
+    auto consistent_version() const -> int override { return version; }
+};
+
+}  // namespace
+
+template <>
+struct sboptr::is_bitwise_copyable<limits> : std::true_type {};
+
+TEST_CASE("Seqlock pointers") {
+    using ptr = sboptr::seqlock_sbo_ptr<config, 32>;
+
+    static_assert(ptr::stores_inline<limits>);
+    static_assert(!ptr::stores_inline<named>);
+
+    SECTION("Empty until stored") {
+        auto p = ptr{};
+        CHECK(p.load() == nullptr);
+    }
+
+    SECTION("In place values") {
+        auto p = ptr{};
+        p.emplace<limits>(1);
+        auto const value = p.load();
+        REQUIRE(value != nullptr);
+        CHECK(value->consistent_version() == 1);
+
+        p.store(limits{2});
+        CHECK(p.load()->consistent_version() == 2);
+        CHECK(value->consistent_version() == 1);
+        CHECK(p.retired_count() == 0);
+
+        p.reset();
+        CHECK(p.load() == nullptr);
+    }
+
+    SECTION("Heap values are freed once replaced") {
+        {
+            auto p = ptr{};
+            p.emplace<named>(1);
+            CHECK(named::instances == 1);
+
+            auto value = p.load();
+            CHECK(value->consistent_version() == 1);
+            CHECK(named::instances == 2);
+
+            p.emplace<named>(2);
+            CHECK(p.retired_count() == 0);
+            CHECK(named::instances == 2);
+            CHECK(p.load()->consistent_version() == 2);
+
+            p.emplace<limits>(3);
+            CHECK(named::instances == 1);
+            CHECK(p.load()->consistent_version() == 3);
+
+            p.emplace<named>(4);
+        }
+        CHECK(named::instances == 0);
+    }
+
+    SECTION("Throwing constructors keep the old value") {
+        auto p = ptr{};
+        p.emplace<named>(1);
+        CHECK_THROWS_AS(p.emplace<throwing>(2), std::runtime_error);
+        CHECK(p.load()->consistent_version() == 1);
+
+        p.emplace<limits>(3);
+        CHECK_THROWS_AS(p.emplace<throwing>(4), std::runtime_error);
+        CHECK(p.load()->consistent_version() == 3);
+        CHECK(p.retired_count() == 0);
+    }
+
+    SECTION("Allocation failures keep the old value") {
+        auto p = sboptr::pmr::seqlock_sbo_ptr<config, 32>{std::pmr::null_memory_resource()};
+        CHECK_THROWS_AS(p.emplace<named>(1), std::bad_alloc);
+        CHECK(p.load() == nullptr);
+
+        // In place values need no allocation
+        p.emplace<limits>(2);
+        CHECK_THROWS_AS(p.emplace<named>(3), std::bad_alloc);
+        CHECK(p.load()->consistent_version() == 2);
+        CHECK(named::instances == 0);
+    }
+
+    SECTION("Allocators") {
+        auto resource = std::pmr::monotonic_buffer_resource{};
+        auto p = sboptr::pmr::seqlock_sbo_ptr<config, 32>{&resource};
+        p.emplace<named>(1);
+        auto const value = p.load();
+        CHECK(value.get_allocator().resource() == &resource);
+        CHECK(value->consistent_version() == 1);
+    }
+}
+
+TEST_CASE("Seqlock pointers free values while other loads are in progress") {
+    auto p = sboptr::seqlock_sbo_ptr<config, 32>{};
+
+    // Starts a load of the current value, which stays in progress until opened
+    auto const start_load = [&] {
+        gated::closed = true;
+        auto reader = std::thread{[&] {
+            auto const value = p.load();
+            CHECK(value->consistent_version() > 0);
+        }};
+        while (gated::waiting == 0) {
+            std::this_thread::yield();
+        }
+        return reader;
+    };
+
+    p.emplace<gated>(1);
+    auto first = start_load();
+    p.emplace<gated>(2);
+    p.emplace<gated>(3);
+    // The first load may still see either
+    CHECK(p.retired_count() == 2);
+    gated::closed = false;
+    first.join();
+
+    auto second = start_load();
+    p.emplace<gated>(4);
+    p.emplace<gated>(5);
+    // The value 1 is freed, as only the first load could see it; 2 and 3
+    // were retired in the epoch of the second load, and wait for it
+    CHECK(p.retired_count() == 3);
+    CHECK(gated::instances == 5);
+    gated::closed = false;
+    second.join();
+
+    // Once no load is in progress, everything retired is freed
+    p.reclaim();
+    CHECK(p.retired_count() == 0);
+    CHECK(gated::instances == 1);
+}
+
+TEST_CASE("Seqlock pointers under concurrent reads") {
+    static constexpr auto stores = 20'000;
+    static constexpr auto reader_count = 3;
+
+    auto run = [](auto make) {
+        auto p = sboptr::seqlock_sbo_ptr<config, 32>{};
+        make(p, 0);
+
+        auto done = std::atomic<bool>{false};
+        auto torn_reads = std::atomic<int>{0};
+        auto readers = std::vector<std::thread>{};
+        for (auto r = 0; r < reader_count; ++r) {
+            readers.emplace_back([&] {
+                auto last = 0;
+                while (!done.load(std::memory_order_acquire)) {
+                    auto const value = p.load();
+                    // Never empty, and versions only grow
+                    auto const version = value ? value->consistent_version() : -1;
+                    if (version < last) {
+                        ++torn_reads;
+                    }
+                    last = version;
+                }
+            });
+        }
+
+        auto failed_stores = 0;
+        for (auto i = 1; i <= stores; ++i) {
+            make(p, i);
+            // Throwing stores leave the last value published
+            if (i % 16 == 0) {
+                try {
+                    p.template emplace<throwing>(i);
+                } catch (std::runtime_error const&) {
+                    ++failed_stores;
+                }
+            }
+        }
+        CHECK(failed_stores == stores / 16);
+
+        // Retired values are freed while the loads go on
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+        while (p.retired_count() != 0 && std::chrono::steady_clock::now() < deadline) {
+            p.reclaim();
+            std::this_thread::yield();
+        }
+        CHECK(p.retired_count() == 0);
+
+        done.store(true, std::memory_order_release);
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        CHECK(torn_reads == 0);
+        CHECK(p.load()->consistent_version() == stores);
+    };
+
+    SECTION("In place values") {
+        run([](auto& p, int const version) { p.template emplace<limits>(version); });
+    }
+
+    SECTION("Heap values") {
+        run([](auto& p, int const version) { p.template emplace<named>(version); });
+        CHECK(named::instances == 0);
+    }
+}
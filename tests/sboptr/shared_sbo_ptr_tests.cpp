@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include "sboptr/shared_sbo_ptr.hpp"
+
+#include "fixtures.hpp"
+
+namespace {
+
+using namespace fixtures;
+
+// Pinned objects can be shared, as they are never moved
+class pinned final : public shape {
+  public:
+    pinned() = default;
+    pinned(pinned&&) = delete;
+
+    auto area() const noexcept -> int override { return 1; }
+};
+
+// Counts live allocations
+class counting_resource : public std::pmr::memory_resource {
+  public:
+    int allocations = 0;
+
+  private:
+    auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        --allocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override { return this == &other; }
+};
+
+}  // namespace
+
+TEMPLATE_TEST_CASE(
+    "Shared pointers",
+    "",
+    (sboptr::shared_sbo_ptr<shape, 16>),
+    (sboptr::shared_sbo_ptr<shape, 16, sboptr::pooled>),
+    (sboptr::local_shared_sbo_ptr<shape, 16>)) {
+    using ptr = TestType;
+
+    static_assert(ptr::template stores_inline<square>);
+    static_assert(!ptr::template stores_inline<big_square>);
+
+    SECTION("Empty") {
+        auto p = ptr{};
+        CHECK(p == nullptr);
+        CHECK(!p);
+        CHECK(p.use_count() == 0);
+    }
+
+    SECTION("Copies share the object") {
+        {
+            auto p = ptr{square{3}};
+            CHECK(square::instances == 1);
+            CHECK(!p.on_heap());
+
+            auto q = p;
+            CHECK(square::instances == 1);
+            CHECK(q == p);
+            CHECK(p.use_count() == 2);
+
+            static_cast<square&>(*q).side = 4;
+            CHECK(p->area() == 16);
+
+            auto r = std::move(q);
+            CHECK(q == nullptr);
+            CHECK(p.use_count() == 2);
+
+            p.reset();
+            CHECK(square::instances == 1);
+            CHECK(r.use_count() == 1);
+        }
+        CHECK(square::instances == 0);
+    }
+
+    SECTION("Big objects go to the heap") {
+        {
+            auto p = ptr{std::in_place_type<big_square>, 3};
+            CHECK(p.on_heap());
+            CHECK(p->area() == 9);
+
+            auto q = p;
+            CHECK(big_square::instances == 1);
+        }
+        CHECK(big_square::instances == 0);
+    }
+
+    SECTION("Emplace leaves other references alone") {
+        auto p = ptr{std::in_place_type<square>, 2};
+        auto const q = p;
+        p.template emplace<big_square>(3);
+        CHECK(p.use_count() == 1);
+        CHECK(q->area() == 4);
+        CHECK(p->area() == 9);
+    }
+
+    SECTION("Assignment") {
+        auto p = ptr{square{2}};
+        auto q = ptr{square{3}};
+        q = p;
+        CHECK(square::instances == 1);
+        CHECK(q->area() == 4);
+        q = nullptr;
+        CHECK(p.use_count() == 1);
+    }
+
+    SECTION("Type queries") {
+        auto const p = ptr{square{2}};
+        CHECK(p.template holds<square>());
+        CHECK(!p.template holds<big_square>());
+        CHECK(p.template get_if<square>()->side == 2);
+        CHECK(p.template get_if<big_square>() == nullptr);
+    }
+
+    SECTION("Pinned objects") {
+        auto const p = ptr{std::in_place_type<pinned>};
+        CHECK(p->area() == 1);
+    }
+
+    SECTION("Throwing constructors") {
+        struct throwing : shape {
+            throwing() { throw std::runtime_error{"throwing"}; }
+            auto area() const noexcept -> int override { return 0; }
+        };
+
+        auto p = ptr{square{2}};
+        CHECK_THROWS(p.template emplace<throwing>());
+        CHECK(p->area() == 4);
+    }
+}
+
+TEST_CASE("Shared pointers with allocators") {
+    auto resource = counting_resource{};
+    auto const alloc = std::pmr::polymorphic_allocator<std::byte>{&resource};
+
+    SECTION("Small objects share the block allocation") {
+        auto p = sboptr::pmr::shared_sbo_ptr<shape, 16>{std::allocator_arg, alloc, square{2}};
+        CHECK(resource.allocations == 1);
+        auto const q = p;
+        CHECK(resource.allocations == 1);
+
+        p.emplace<big_square>(3);
+        CHECK(resource.allocations == 3);
+        CHECK(p->area() == 9);
+    }
+    CHECK(resource.allocations == 0);
+}
+
+TEST_CASE("Instrumented shared pointers") {
+    using ptr = sboptr::shared_sbo_ptr<shape, 16, sboptr::instrumented>;
+
+    auto const stats_of = [](std::string_view const name) {
+        auto const all = sboptr::get_heap_fallback_stats();
+        auto const iter = std::find_if(all.begin(), all.end(), [&](auto const& s) {
+            return s.type.size() >= name.size() && s.type.substr(s.type.size() - name.size()) == name;
+        });
+        REQUIRE(iter != all.end());
+        return *iter;
+    };
+
+    sboptr::reset_heap_fallback_stats();
+
+    auto const small = ptr{square{2}};
+    auto const big = ptr{std::in_place_type<big_square>, 3};
+    // Copies share the object, so they are not counted
+    auto const copy = big;
+
+    auto const small_stats = stats_of("::square");
+    CHECK(small_stats.inline_constructions == 1);
+    CHECK(small_stats.heap_constructions == 0);
+
+    auto const big_stats = stats_of("::big_square");
+    CHECK(big_stats.size == sizeof(big_square));
+    CHECK(big_stats.inline_constructions == 0);
+    CHECK(big_stats.heap_constructions == 1);
+    CHECK(big_stats.heap_bytes == sizeof(big_square));
+    CHECK(big_stats.copies == 0);
+}
+
+TEST_CASE("Shared pointers to bases without virtual destructor") {
+    class plain_shape {
+      public:
+        [[nodiscard]] virtual auto area() const noexcept -> int = 0;
+    };
+
+    class plain_square final : public plain_shape {
+      public:
+        int* instances;
+        std::array<int, 8> sides = {};
+
+        explicit plain_square(int* instances) : instances{instances} { ++*instances; }
+        plain_square(plain_square const& other) : instances{other.instances} { ++*instances; }
+        ~plain_square() { --*instances; }
+
+        auto area() const noexcept -> int override { return 1; }
+    };
+
+    auto instances = 0;
+    {
+        auto small = sboptr::shared_sbo_ptr<plain_shape, sizeof(plain_square)>{std::in_place_type<plain_square>, &instances};
+        auto big = sboptr::shared_sbo_ptr<plain_shape, 8>{std::in_place_type<plain_square>, &instances};
+        auto const copy = big;
+        CHECK(instances == 2);
+    }
+    CHECK(instances == 0);
+}
+
+TEST_CASE("Shared pointers across threads") {
+    constexpr auto copies = 10'000;
+
+    {
+        auto const p = sboptr::shared_sbo_ptr<shape, 16>{square{2}};
+        auto failures = std::atomic<int>{0};
+        auto threads = std::vector<std::thread>{};
+        for (auto t = 0; t < 4; ++t) {
+            threads.emplace_back([p, &failures] {
+                for (auto i = 0; i < copies; ++i) {
+                    auto const q = p;
+                    if (q->area() != 4) {
+                        ++failures;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(failures == 0);
+        CHECK(p.use_count() == 1);
+    }
+    CHECK(square::instances == 0);
+}